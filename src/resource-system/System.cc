@@ -1,8 +1,10 @@
 #include "System.hh"
 
+#include <mutex>
 #include <shared_mutex>
 
 #include <clean-core/assert.hh>
+#include <clean-core/indices_of.hh>
 #include <clean-core/map.hh>
 #include <clean-core/vector.hh>
 
@@ -13,21 +15,45 @@
 
 struct res::System::pimpl
 {
+    // NOTE: slots are individually allocated, handles point to them
     std::shared_mutex res_slots_mutex;
-    cc::map<base::res_hash, detail::resource_slot> res_slots;
+    cc::map<base::res_hash, cc::unique_ptr<detail::resource_slot>> res_slots;
 };
 
+namespace
+{
+// replaces the cached content of a slot, unless a newer one was cached in the meantime
+// NOTE: the previous content is only released by the next collect_garbage, so pointers to its data stay valid until then (see handle::try_get)
+void set_cached_content(res::detail::resource_slot& r, res::base::content_ref content)
+{
+    auto lock = std::lock_guard{r.cache_mutex};
+    if (content.generation < r.cached_gen.load())
+        return;
+
+    r.cached_data.store(content.data_ptr, std::memory_order_release);
+    r.cached_gen.store(content.generation, std::memory_order_release);
+    if (r.cached_content.owner.desc != nullptr && r.cached_content.data_ptr != content.data_ptr)
+        r.replaced_contents.push_back(cc::move(r.cached_content));
+    r.cached_content = cc::move(content);
+}
+} // namespace
+
 res::System& res::system()
 {
     static System system;
     return system;
 }
 
-bool res::detail::resource_is_loaded_no_error(resource_slot const& r) { return r.cached_value != nullptr; }
+bool res::detail::resource_is_loaded_no_error(resource_slot const& r) { return r.cached_data.load(std::memory_order_acquire) != nullptr; }
 
 res::base::res_hash res::detail::resource_get_hash(resource_slot& r) { return r.resource; }
 
-res::detail::resource_slot* res::detail::get_or_create_resource_slot(res::base::computation_desc desc, cc::span<res::base::res_hash const> args, bool is_volatile, bool is_persisted, base::deserialize_fun_ptr deserialize)
+res::detail::resource_slot* res::detail::get_or_create_resource_slot(res::base::computation_desc desc,
+                                                                     cc::span<res::base::res_hash const> args,
+                                                                     bool is_volatile,
+                                                                     bool is_persisted,
+                                                                     bool has_dynamic_args,
+                                                                     base::deserialize_fun_ptr deserialize)
 {
     auto& system = res::system();
     auto& base = system.base();
@@ -39,14 +65,19 @@ res::detail::resource_slot* res::detail::get_or_create_resource_slot(res::base::
     rdesc.args = args;
     rdesc.is_volatile = is_volatile;
     rdesc.is_persisted = is_persisted;
+    rdesc.has_dynamic_args = has_dynamic_args;
     rdesc.deserialize = deserialize;
     auto [res, counter] = base.define_resource(rdesc);
 
+    // only handles reference the resource
+    counter->dec();
+
     auto& mutex = system.m->res_slots_mutex;
     auto& slots = system.m->res_slots;
 
     mutex.lock_shared();
-    auto p_slot = slots.get_ptr(res);
+    auto pp_slot = slots.get_ptr(res);
+    auto p_slot = pp_slot ? pp_slot->get() : nullptr;
     mutex.unlock_shared();
 
     // found slot
@@ -54,26 +85,24 @@ res::detail::resource_slot* res::detail::get_or_create_resource_slot(res::base::
         return p_slot;
 
     // prepare resource
-    resource_slot slot;
-    slot.system = &system;
-    slot.resource = res;
-    slot.resource_ref_count = counter;
+    auto slot = cc::make_unique<resource_slot>();
+    slot->system = &system;
+    slot->resource = res;
+    slot->resource_ref_count = counter;
 
     // write to db
     mutex.lock();
     // need to check again
-    p_slot = slots.get_ptr(res);
-    if (!p_slot)
-    {
-        p_slot = &slots[res];
-        *p_slot = slot;
-    }
+    auto& entry = slots[res];
+    if (entry == nullptr)
+        entry = cc::move(slot);
+    p_slot = entry.get();
     mutex.unlock();
 
     return p_slot;
 }
 
-void const* res::detail::resource_try_get(resource_slot& r)
+void const* res::detail::resource_try_get(resource_slot& r, base::priority prio)
 {
     // TODO: does this function need special threadsafety considerations?
     //    -> we are working with basically immutable values
@@ -81,24 +110,118 @@ void const* res::detail::resource_try_get(resource_slot& r)
     auto& base = r.system->base();
 
     // fastest path: valid cached value
-    if (base.is_up_to_date(r.cached_gen))
-        return r.cached_value; // might be nullptr
+    if (base.is_up_to_date(r.cached_gen.load(std::memory_order_acquire)))
+        return r.cached_data.load(std::memory_order_acquire); // might be nullptr
 
     // otherwise, try to get data
-    auto data = base.try_get_resource_content(r.resource);
+    // NOTE: only updates of the same slot are serialized
+    auto data = base.try_get_resource_content(r.resource, true, prio);
     if (data.has_value())
+        set_cached_content(r, cc::move(data.value()));
+
+    return r.cached_data.load(std::memory_order_acquire); // is nullptr if not loaded
+}
+
+int res::detail::resource_try_get_many(cc::span<resource_slot* const> slots, cc::function_ref<void(size_t, void const*)> on_data, base::priority prio)
+{
+    static thread_local cc::vector<size_t> stale_slots;
+    static thread_local cc::vector<base::res_hash> stale_res;
+    static thread_local cc::vector<cc::optional<base::content_ref>> stale_content;
+    stale_slots.clear();
+    stale_res.clear();
+
+    System* system = nullptr;
+    auto loaded = 0;
+
+    // fastest path: valid cached values
+    for (size_t i = 0; i < slots.size(); ++i)
+    {
+        auto const slot = slots[i];
+        if (slot == nullptr)
+        {
+            on_data(i, nullptr);
+            continue;
+        }
+
+        CC_ASSERT((system == nullptr || system == slot->system) && "all handles must belong to the same system");
+        system = slot->system;
+
+        if (system->base().is_up_to_date(slot->cached_gen.load(std::memory_order_acquire)))
+        {
+            auto const data = slot->cached_data.load(std::memory_order_acquire); // might be nullptr
+            on_data(i, data);
+            loaded += data != nullptr;
+            continue;
+        }
+
+        stale_slots.push_back(i);
+        stale_res.push_back(slot->resource);
+    }
+
+    if (stale_slots.empty())
+        return loaded;
+
+    // otherwise, try to get all missing data at once
+    stale_content.resize(stale_res.size());
+    system->base().try_get_resource_contents(stale_res, stale_content, true, prio);
+
+    // NOTE: see resource_try_get
+    for (auto j : cc::indices_of(stale_slots))
+        if (stale_content[j].has_value())
+            set_cached_content(*slots[stale_slots[j]], cc::move(stale_content[j].value()));
+    stale_content.clear();
+
+    for (auto i : stale_slots)
     {
-        r.cached_value = data.value().data_ptr;
-        r.cached_gen = data.value().generation;
+        auto const data = slots[i]->cached_data.load(std::memory_order_acquire); // is nullptr if not loaded
+        on_data(i, data);
+        loaded += data != nullptr;
     }
 
-    return r.cached_value; // is nullptr if not loaded
+    return loaded;
 }
 
 void res::System::process_all() { base_system.process_all(); }
 
+void res::System::process_until_idle() { base_system.process_until_idle(); }
+
+int res::System::process_main_thread_jobs() { return base_system.process_main_thread_jobs(); }
+
+void res::System::start_workers(int num_threads) { base_system.start_workers(num_threads); }
+
+void res::System::stop_workers() { base_system.stop_workers(); }
+
 void res::System::invalidate_volatile_resources() { base_system.invalidate_volatile_resources(); }
 
+void res::System::invalidate_volatile_resource(base::res_hash res) { base_system.invalidate_volatile_resource(res); }
+
+int64_t res::System::collect_garbage()
+{
+    {
+        auto lock = std::shared_lock(m->res_slots_mutex);
+        for (auto&& [res, slot] : m->res_slots)
+        {
+            auto slot_lock = std::lock_guard{slot->cache_mutex};
+
+            // pointers to replaced contents are only valid until here (see handle::try_get)
+            slot->replaced_contents.clear();
+
+            // no handles left
+            if (slot->resource_ref_count->is_referenced())
+                continue;
+
+            if (slot->cached_content.owner.desc != nullptr)
+            {
+                slot->cached_gen.store(-1, std::memory_order_release);
+                slot->cached_data.store(nullptr, std::memory_order_release);
+                slot->cached_content = base::content_ref();
+            }
+        }
+    }
+
+    return base_system.evict_unused_content();
+}
+
 res::System::System() { m = cc::make_unique<pimpl>(); }
 
 res::System::~System()
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <clean-core/function_ref.hh>
 #include <clean-core/unique_ptr.hh>
 
 #include <resource-system/base/api.hh>
@@ -7,8 +8,14 @@
 
 namespace res::detail
 {
-detail::resource_slot* get_or_create_resource_slot(
-    res::base::computation_desc desc, cc::span<res::base::res_hash const> args, bool is_volatile, bool is_persisted, base::deserialize_fun_ptr deserialize);
+detail::resource_slot* get_or_create_resource_slot(res::base::computation_desc desc,
+                                                   cc::span<res::base::res_hash const> args,
+                                                   bool is_volatile,
+                                                   bool is_persisted,
+                                                   bool has_dynamic_args,
+                                                   base::deserialize_fun_ptr deserialize);
+void const* resource_try_get(detail::resource_slot& r, base::priority prio);
+int resource_try_get_many(cc::span<detail::resource_slot* const> slots, cc::function_ref<void(size_t, void const*)> on_data, base::priority prio);
 }
 
 namespace res
@@ -26,10 +33,32 @@ public:
     /// NOTE: this API is WIP
     void process_all();
 
+    /// blocks until all requested resources are processed
+    /// the calling thread helps with the processing
+    void process_until_idle();
+
+    /// executes all pending computations of main-thread nodes (see executor_id::main_thread)
+    /// should be called at a controlled point on the main thread, e.g. once per frame
+    /// returns the number of executed computations
+    /// NOTE: process_until_idle also executes them
+    int process_main_thread_jobs();
+
+    /// starts background worker threads that process requested resources
+    /// num_threads < 0 means one worker per hardware thread
+    void start_workers(int num_threads = -1);
+    void stop_workers();
+
     base::ResourceSystem& base() { return base_system; }
     base::ResourceSystem const& base() const { return base_system; }
 
     void invalidate_volatile_resources();
+    void invalidate_volatile_resource(base::res_hash res);
+
+    /// releases the cached content of all resources without handles
+    /// and then evicts all unreferenced content (see base::ResourceSystem::evict_unused_content)
+    /// returns the number of freed bytes
+    /// NOTE: not cheap
+    int64_t collect_garbage();
 
     System();
     ~System();
@@ -45,6 +74,11 @@ private:
                                                                       cc::span<res::base::res_hash const> args,
                                                                       bool is_volatile,
                                                                       bool is_persisted,
+                                                                      bool has_dynamic_args,
                                                                       base::deserialize_fun_ptr deserialize);
+    friend void const* detail::resource_try_get(detail::resource_slot& r, base::priority prio);
+    friend int detail::resource_try_get_many(cc::span<detail::resource_slot* const> slots,
+                                             cc::function_ref<void(size_t, void const*)> on_data,
+                                             base::priority prio);
 };
 } // namespace res
@@ -7,15 +7,24 @@
 #include <clean-core/intrinsics.hh>
 #include <clean-core/map.hh>
 #include <clean-core/set.hh>
+#include <clean-core/utility.hh>
 #include <clean-core/vector.hh>
 
 #include <rich-log/log.hh>
 
+#include <resource-system/detail/flat_hash_map.hh>
 #include <resource-system/detail/hash_helper.hh>
 #include <resource-system/detail/log.hh>
+#include <resource-system/detail/mpmc_queue.hh>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
 #include <mutex>
 #include <shared_mutex>
+#include <thread>
 
 #define ENABLE_VERBOSE_LOG 0
 
@@ -27,6 +36,53 @@
 
 namespace res::base
 {
+namespace detail
+{
+// a job that waits for some of its args
+// it is registered as waiter at each missing arg and enqueued again once the last missing arg is ready
+// NOTE: this is allocated per waiting job (and not stored in res_desc)
+//       because multiple jobs (content hash + content, different generations) can wait for the same resource
+struct res_wait_state
+{
+    res_hash res;
+    int gen = -1;
+    bool need_content = false;     // queue of the job (content or content hash)
+    bool wait_for_content = false; // if true, args must have content, otherwise their content hash is enough
+    priority prio = priority::normal; // the job is enqueued again with this priority, args are requested with it
+    std::atomic<int> missing_args = 0;
+
+    // if set, this callback is executed instead of enqueuing the job (see notify_when_content_available)
+    cc::unique_function<void()> callback;
+};
+
+// everything that is needed to store the result of a computation
+struct computation_job
+{
+    res_hash res;
+    int gen = -1;
+    invoc_hash invoc;
+    bool is_volatile = false;
+    bool is_persisted = false;
+    bool has_dynamic_args = false;
+    deserialize_fun_ptr deserialize = nullptr;
+    cc::function_ptr<content_hash(void const*)> make_hash = nullptr;
+};
+
+// state of an async computation that was started but not completed yet
+// NOTE: owned by the computation_promise
+struct async_computation
+{
+    ResourceSystem* system = nullptr;
+    computation_job job;
+
+    // keeps the arg content alive until completion
+    cc::vector<content_ref> args;
+
+    // see computation_promise::add_dynamic_arg
+    cc::vector<cc::pair<res_hash, content_hash>> dynamic_args;
+};
+} // namespace detail
+
 namespace
 {
 [[maybe_unused]] cc::string shorthash(hash const& h)
@@ -50,289 +106,1410 @@ namespace
 [[maybe_unused]] cc::string shorthash(content_hash const& h) { return cc::format("\u001b[34m%s\u001b[0m", shorthash((hash)h)); }
 [[maybe_unused]] cc::string shorthash(comp_hash const& h) { return cc::format("\u001b[36m%s\u001b[0m", shorthash((hash)h)); }
 
-// TODO: flat?
-struct res_desc
-{
-    comp_hash comp;
-    cc::vector<res_hash> args;
-
-    bool is_volatile = false;
-    bool is_persisted = false;
+using detail::res_wait_state;
+} // namespace
 
-    deserialize_fun_ptr deserialize = nullptr;
+namespace detail
+{
+// NOTE: content descs are pointer-stable and never removed
+//       so resources can cache pointers to them
+//       however, their data can be evicted (see ResourceSystem::set_memory_budget)
+struct content_desc
+{
+    // NOTE: serialized_data and error_data are immutable while the content is resident
+    //       the runtime data is moved into runtime_slots (content.runtime_data is always empty)
+    computation_result content;
+
+    // [runtime data]
+    // one slot per deserializer (plus the runtime data that the computation provided)
+    // the slots form a singly linked list that only grows while the content is resident
+    // NOTE: new slots are published atomically at the head and are immutable once ready
+    //       so lookups never lock and each (content, deserializer) pair is deserialized at most once
+    // NOTE: the list is only freed when nobody references the content (see try_evict)
+    struct runtime_slot
+    {
+        deserialize_fun_ptr deserialize = nullptr;
+        content_runtime_data data;         // only valid once is_ready
+        std::atomic<bool> is_ready = false; // false while being deserialized
+        runtime_slot* next = nullptr;
+    };
+    mutable std::atomic<runtime_slot*> runtime_slots = nullptr;
 
-    // NOTE: this only tracks external references
-    //       internal references are part of the GC process
-    ref_count* ref_counter = nullptr;
+    // number of content_refs (and pins) referencing this content
+    // is evicted_ref_count if the data was evicted
+    // NOTE: the evictor only evicts content with ref_count == 0 (and under the shard writer lock)
+    mutable std::atomic<int> ref_count = 0;
+    static constexpr int evicted_ref_count = -1;
 
-    // [cache for resources]
-    // TODO: store this in a separate store?
-    //       -> reduces contention a lot in traversal-during-computation scenarios
-    // content is considered up-to-date if content_gen == current_gen
-    // in that case, content_name is always valid
-    // however, content_data might be nullopt if it wasn't required
-    int enqueued_for_name_gen = -1;    // what is gen after queue finished?
-    int enqueued_for_content_gen = -1; // what is gen after queue finished?
-    int content_gen = -1;
-    content_hash content_name;
-    cc::optional<content_ref> content_data; // TODO: refcounting
-};
+    // CLOCK reference bit, set whenever a new reference is acquired
+    mutable std::atomic<bool> was_accessed = true;
 
-struct content_desc
-{
-    // TODO: refcounting
+    // incremented on each eviction
+    // runtime data pointers cached in res_cache are only valid for the same epoch
+    std::atomic<uint32_t> epoch = 0;
 
-    mutable computation_result content;
-    // TODO: this is currently needed due to lazy deser
-    //       that's also the reason for "mutable" here
-    mutable std::mutex content_mutex_runtime_data;
+    // approximate memory footprint, see update_size
+    mutable std::atomic<int64_t> size_bytes = 0;
 
     content_desc() = default;
-    content_desc(computation_result content) : content(cc::move(content)) {}
+    content_desc(computation_result content) : content(cc::move(content))
+    {
+        adopt_runtime_data();
+        update_size();
+    }
+    ~content_desc() { free_data(); }
 
-    bool has_data() const { return content.serialized_data.has_value() || !content.runtime_data.empty() || content.error_data.has_value(); }
+    bool has_data() const
+    {
+        return content.serialized_data.has_value() || runtime_slots.load(std::memory_order_relaxed) != nullptr || content.error_data.has_value();
+    }
     bool has_serializable_data() const { return content.serialized_data.has_value() || content.error_data.has_value(); }
+    bool is_evicted() const { return ref_count.load() == evicted_ref_count; }
+
+    // acquires a new reference unless the content is evicted
+    bool try_acquire() const
+    {
+        auto count = ref_count.load();
+        while (count != evicted_ref_count)
+            if (ref_count.compare_exchange_weak(count, count + 1))
+            {
+                was_accessed.store(true, std::memory_order_relaxed);
+                return true;
+            }
+        return false;
+    }
+    // NOTE: only valid if the caller already holds a reference
+    void acquire() const { ref_count.fetch_add(1); }
+    void release() const
+    {
+        [[maybe_unused]] auto prev = ref_count.fetch_sub(1);
+        CC_ASSERT(prev > 0 && "unbalanced content refcounting");
+    }
 
+    // returns the runtime data for the given deserializer
+    // returns nullptr for errors
+    // new runtime data is added to memory_usage
+    // NOTE: caller must hold a reference
+    // NOTE: lock-free if the runtime data already exists
+    //       otherwise, only callers that need the same deserializer wait for the deserialization
     // NOTE: is kinda not const because it performs lazy deserialization
     //       but this is a "mutable cached internal" scenario
-    content_ref make_ref(int gen, content_hash hash, deserialize_fun_ptr deserialize) const
+    void const* get_runtime_data([[maybe_unused]] content_hash hash, deserialize_fun_ptr deserialize, std::atomic<int64_t>& memory_usage) const
     {
         CC_ASSERT(has_data() && "how does this happen?");
-        content_ref r;
-        r.generation = gen;
-        r.hash = hash;
 
+        if (content.error_data.has_value())
+            return nullptr;
+
+        // try to find (possibly in-flight) runtime data with the given deserializer
+        auto head = runtime_slots.load(std::memory_order_acquire);
+        auto slot = find_slot(head, deserialize);
+
+        // if none available, publish a new slot and deserialize
+        if (slot == nullptr)
         {
-            if (content.error_data.has_value())
-                r.error_msg = content.error_data.value().message;
-            else
+            CC_ASSERT(deserialize && "no runtime data + no deserializer should not be possible");
+            CC_ASSERT(content.serialized_data.has_value() && "no runtime data + no serialized data should not be possible");
+
+            auto new_slot = cc::alloc<runtime_slot>();
+            new_slot->deserialize = deserialize;
+            while (true)
             {
-                // TODO: less locking ...
-                auto lock = std::lock_guard(content_mutex_runtime_data);
-                auto need_deser = true;
+                new_slot->next = head;
+                if (runtime_slots.compare_exchange_weak(head, new_slot, std::memory_order_acq_rel, std::memory_order_acquire))
+                    break;
 
-                // try to find deserialized runtime data with the given deserializer
-                for (auto& runtime_data : content.runtime_data)
+                // someone else published a slot in the meantime (head is updated)
+                if (auto const other = find_slot(head, deserialize))
                 {
-                    if (runtime_data.deserialize == deserialize)
-                    {
-                        need_deser = false;
-                        r.data_ptr = runtime_data.data.data_ptr;
-                        break;
-                    }
+                    cc::free(new_slot);
+                    new_slot = nullptr;
+                    slot = other;
+                    break;
                 }
+            }
 
-                // if none available, deserialize
-                if (need_deser)
-                {
-                    CC_ASSERT(deserialize && "no runtime data + no deserializer should not be possible");
-                    CC_ASSERT(content.serialized_data.has_value() && "no runtime data + no serialized data should not be possible");
-
-                    LOG_VERBOSE("content %s is deserialized using %s", shorthash(hash), (void*)deserialize);
-                    auto& data = content.runtime_data.emplace_back();
-                    data.deserialize = deserialize;
-                    data.data = deserialize(content.serialized_data.value().blob);
-                    r.data_ptr = data.data.data_ptr;
-                }
+            if (new_slot != nullptr)
+            {
+                LOG_VERBOSE("content %s is deserialized using %s", shorthash(hash), (void*)deserialize);
+                new_slot->data = deserialize(content.serialized_data.value().bytes());
 
-                // also return ref to any serialized data
-                if (content.serialized_data.has_value())
-                    r.serialized_data = content.serialized_data.value().blob;
+                auto const added_size = int64_t(new_slot->data.size_bytes);
+                size_bytes.fetch_add(added_size);
+                memory_usage.fetch_add(added_size);
+
+                new_slot->is_ready.store(true, std::memory_order_release);
+                return new_slot->data.data_ptr;
             }
         }
 
+        // the same pair might currently be deserialized by someone else
+        while (!slot->is_ready.load(std::memory_order_acquire))
+            std::this_thread::yield();
+
+        return slot->data.data_ptr;
+    }
+
+    // makes a ref given previously queried runtime data (see get_runtime_data)
+    // NOTE: adopts a reference that the caller already acquired
+    // NOTE: does not lock because serialized_data and error_data are immutable
+    content_ref make_ref(int gen, content_hash hash, void const* runtime_data) const
+    {
+        CC_ASSERT(has_data() && "how does this happen?");
+        content_ref r;
+        r.generation = gen;
+        r.hash = hash;
+        r.owner = detail::content_owner(this);
+
+        if (content.error_data.has_value())
+            r.error_msg = content.error_data.value().message;
+        else
+        {
+            r.data_ptr = runtime_data;
+
+            // also return ref to any serialized data
+            if (content.serialized_data.has_value())
+                r.serialized_data = content.serialized_data.value().bytes();
+        }
+
         return r;
     }
+    // NOTE: adopts a reference that the caller already acquired
     content_ref make_serialize_ref(int gen, content_hash hash) const
     {
         CC_ASSERT(has_serializable_data());
         content_ref r;
         r.generation = gen;
         r.hash = hash;
+        r.owner = detail::content_owner(this);
 
         if (content.error_data.has_value())
             r.error_msg = content.error_data.value().message;
         else
         {
             CC_ASSERT(content.serialized_data.has_value());
-            r.serialized_data = content.serialized_data.value().blob;
+            r.serialized_data = content.serialized_data.value().bytes();
         }
 
         return r;
     }
-};
 
-// TODO: flat?
-struct invoc_desc
-{
-    content_hash content;
-    bool is_persisted = false;
+    // refills an evicted desc
+    // NOTE: must be called under the shard writer lock
+    void repopulate(computation_result new_content)
+    {
+        CC_ASSERT(is_evicted());
+        content = cc::move(new_content);
+        adopt_runtime_data();
+        update_size();
+        was_accessed.store(true);
+        ref_count.store(0);
+    }
 
-    // TODO:
-    // if we had an was_loaded_from_content_provider, we could make save-to-persistence cheaper
-};
+    // frees all data if the content is unreferenced
+    // returns the number of freed bytes or -1 if the content is still referenced
+    // NOTE: must be called under the shard writer lock
+    int64_t try_evict()
+    {
+        auto expected = 0;
+        if (!ref_count.compare_exchange_strong(expected, evicted_ref_count))
+            return -1;
+
+        auto const freed = size_bytes.load();
+        free_data();
+        epoch.fetch_add(1);
+        size_bytes.store(0);
+        return freed;
+    }
 
-content_hash make_content_hash(computation_result const& res, invoc_hash invoc, cc::function_ptr<content_hash(void const*)> make_hash, bool is_volatile)
-{
-    cc::sha1_builder sha1;
-    if (res.serialized_data.has_value()) // normal case
+private:
+    static runtime_slot* find_slot(runtime_slot* head, deserialize_fun_ptr deserialize)
     {
-        sha1.add(cc::as_byte_span(uint32_t(1000)));
-        sha1.add(res.serialized_data.value().blob);
+        for (auto s = head; s != nullptr; s = s->next)
+            if (s->deserialize == deserialize)
+                return s;
+        return nullptr;
     }
-    else if (res.error_data.has_value()) // error case
+
+    // moves the runtime data of the computation into (ready) slots
+    // NOTE: only called while nobody else can access this content
+    void adopt_runtime_data()
     {
-        sha1.add(cc::as_byte_span(uint32_t(2000)));
-        sha1.add(cc::as_byte_span(res.error_data.value().message));
+        CC_ASSERT(runtime_slots.load() == nullptr);
+        for (auto& r : content.runtime_data)
+        {
+            auto slot = cc::alloc<runtime_slot>();
+            slot->deserialize = r.deserialize;
+            slot->data = r.data;
+            slot->is_ready.store(true, std::memory_order_relaxed);
+            slot->next = runtime_slots.load(std::memory_order_relaxed);
+            runtime_slots.store(slot, std::memory_order_relaxed);
+        }
+        content.runtime_data.clear();
     }
-    else if (res.runtime_data.size() == 1 && make_hash) // non-serializable BUT hashable case
+
+    void update_size()
     {
-        sha1.add(cc::as_byte_span(uint32_t(3000)));
-        sha1.add(cc::as_byte_span(make_hash(res.runtime_data[0].data.data_ptr)));
+        int64_t size = sizeof(content_desc);
+        // NOTE: external bytes (e.g. memory mapped files) are not counted, they are not owned and evicting them frees nothing
+        if (content.serialized_data.has_value())
+            size += int64_t(content.serialized_data.value().blob.size());
+        if (content.error_data.has_value())
+            size += int64_t(content.error_data.value().message.size());
+        for (auto s = runtime_slots.load(); s != nullptr; s = s->next)
+            size += int64_t(s->data.size_bytes);
+        size_bytes.store(size);
     }
-    else // non-serializable + non-hashable case
+
+    // runs all deleters and frees the serialized data
+    // NOTE: only called while nobody else can access this content
+    void free_data()
     {
-        CC_ASSERT(res.runtime_data.size() == 1 && "this should not happen. if we have multiple runtime repr, it means it was serializable and the serialized data is deduplicated");
-        sha1.add(cc::as_byte_span(uint32_t(4000)));
-        sha1.add(cc::as_byte_span(invoc));
+        auto s = runtime_slots.exchange(nullptr);
+        while (s != nullptr)
+        {
+            if (s->data.deleter)
+                s->data.deleter(s->data.data_ptr);
 
-        // volatile + non-serializable means we have no idea what the content is
-        // thus we add a basically random value to the hash
-        if (is_volatile)
-            sha1.add(cc::as_byte_span(std::chrono::high_resolution_clock::now().time_since_epoch().count()));
+            auto const next = s->next;
+            cc::free(s);
+            s = next;
+        }
+
+        content = computation_result();
     }
-    return res::detail::finalize_as<content_hash>(sha1);
-}
+};
 
-// NOTE: these are threadsafe via reader/writer lock
-template <class HashT, class ValueT>
-struct MemoryStore
+void acquire_content(content_desc const* desc) { desc->acquire(); }
+void release_content(content_desc const* desc) { desc->release(); }
+} // namespace detail
+
+namespace
 {
-    // returns an optional of get_f(ValueT const&)
-    // if get_f is void, returns a bool that is true iff get_f was called (i.e. the key exists)
-    // NOTE: get_f is called within a reader-lock
-    //       thus, there should be no expensive computation within
-    template <class GetF>
-    auto get(HashT hash, GetF&& get_f)
+using detail::content_desc;
+
+// a minimal test-and-test-and-set lock
+// NOTE: only used for tiny critical sections (a few loads and stores)
+struct spin_lock
+{
+    void lock()
     {
-        using T = std::decay_t<decltype(get_f(_data.get(std::declval<ValueT const&>())))>;
+        while (_locked.exchange(true, std::memory_order_acquire))
+            while (_locked.load(std::memory_order_relaxed))
+                std::this_thread::yield();
+    }
+    void unlock() { _locked.store(false, std::memory_order_release); }
 
-        if constexpr (std::is_same_v<T, void>)
-        {
-            auto has_value = false;
+private:
+    std::atomic<bool> _locked = false;
+};
 
-            {
-                auto lock = std::shared_lock{_mutex};
-                if (auto p_val = _data.get_ptr(hash))
-                {
-                    get_f(static_cast<ValueT const&>(*p_val));
-                    has_value = true;
-                }
-            }
+struct res_desc;
+struct res_cache;
 
-            return has_value;
-        }
-        else
+// value type of the res store
+// NOTE: small on purpose so that it's stored inline in the hash map
+//       a lookup thus touches the map slot and then only the single res_cache line
+struct res_entry
+{
+    res_desc* desc = nullptr;
+    res_cache* cache = nullptr;
+};
+
+// the immutable definition part of a resource
+// NOTE: written once in define_resource and never changed afterwards (except for dependents)
+//       thus it can be read without any locks
+struct res_desc
+{
+    comp_hash comp;
+    cc::span<res_hash const> args; // owned by impl::res_args
+
+    bool is_volatile = false;
+    bool is_persisted = false;
+
+    // see resource_desc::has_dynamic_args
+    bool has_dynamic_args = false;
+
+    // true if this resource is volatile or transitively depends on a volatile resource
+    // only such resources can ever become dirty
+    // NOTE: conservatively true for resources with dynamic args
+    bool depends_on_volatile = false;
+
+    deserialize_fun_ptr deserialize = nullptr;
+
+    // NOTE: this only tracks external references
+    //       internal references are part of the GC process
+    ref_count* ref_counter = nullptr;
+
+    // [cancellation]
+    // counter of a referenced resource that (transitively) waited for this one, see impl::is_needed
+    // only a hint that makes repeated checks cheap, might be outdated
+    std::atomic<ref_count const*> needed_witness = nullptr;
+
+    // [dirty propagation]
+    // all resources that have this one as arg
+    // NOTE: only tracked if depends_on_volatile
+    // NOTE: guarded by impl::dependents_mutex
+    cc::vector<res_entry> dependents;
+
+    // [duplicate jobs]
+    // generation of the computation (or content load) that is in flight, -1 if none
+    // later jobs of the same generation (e.g. enqueued again by a priority boost) are dropped, the running one delivers the content
+    // NOTE: guarded by the res_cache::lock of the resource (which has no room left in its cache line)
+    int computing_gen = -1;
+};
+
+// [cache for resources]
+// the mutable, frequently accessed part of a resource, exactly one cache line
+// content is up-to-date if it was computed after the resource was last marked dirty (content_gen >= dirty_gen)
+// in that case, content_name is always valid
+// however, content might be nullptr if it wasn't required
+// NOTE: generations are only bumped on invalidation, so non-dirty resources stay valid indefinitely
+// NOTE: all fields are guarded by lock
+// NOTE: content is a weak reference that can be evicted at any time (see try_acquire_content)
+//       unless the resource is pinned, in which case it is a strong reference
+struct alignas(64) res_cache
+{
+    int enqueued_for_name_gen = -1;    // what is gen after queue finished?
+    int enqueued_for_content_gen = -1; // what is gen after queue finished?
+    int content_gen = -1;              // gen of the job that computed the content
+    int dirty_gen = 0;                 // gen of the last invalidation that affected this resource
+    content_hash content_name;
+
+    // the content itself plus the runtime data for the deserializer of this resource
+    // NOTE: content descs are pointer-stable
+    content_desc const* content = nullptr;
+    void const* runtime_data = nullptr;
+
+    // [dependency wake-up]
+    // jobs that wait for this resource to have an up-to-date content hash (or content)
+    // they are removed and notified whenever the cache above is updated
+    // NOTE: allocated on first use, most resources never have waiters
+    cc::unique_ptr<cc::vector<res_wait_state*>> waiters;
+
+    uint32_t content_epoch = 0; // epoch of content when runtime_data was cached
+    uint16_t pin_count = 0;
+    spin_lock lock;
+    priority enqueued_priority = priority::normal; // of the latest enqueue, higher requests enqueue again (see try_get_resource_content)
+
+    bool has_content() const { return content != nullptr; }
+
+    // true if the content (hash) can be used by a job or request of the given generation
+    // i.e. if it's not dirty or was computed in the same (or a later) generation
+    // NOTE: the latter is the case for jobs that started before the latest invalidation
+    bool is_valid_for(int gen) const { return content_gen >= 0 && (content_gen >= dirty_gen || content_gen >= gen); }
+
+    // true if a previously enqueued job (of enqueued_gen) will produce content that is valid for gen
+    bool is_enqueued_for(int enqueued_gen, int gen) const { return enqueued_gen >= gen || enqueued_gen >= dirty_gen; }
+
+    // acquires a reference to the cached content
+    // if it was evicted in the meantime, the cache forgets it and false is returned
+    // NOTE: for pinned resources, this always succeeds
+    bool try_acquire_content()
+    {
+        if (content == nullptr)
+            return false;
+
+        if (content->try_acquire())
         {
-            cc::optional<T> res;
+            if (content->epoch.load() == content_epoch)
+                return true;
 
-            {
-                auto lock = std::shared_lock{_mutex};
-                if (auto p_val = _data.get_ptr(hash))
-                    res = get_f(static_cast<ValueT const&>(*p_val));
-            }
+            // evicted and repopulated, i.e. runtime_data is dangling
+            content->release();
+        }
 
-            return res;
+        CC_ASSERT(pin_count == 0 && "pinned content should never be evicted");
+        content = nullptr;
+        runtime_data = nullptr;
+        // allows enqueuing the resource again for the current gen
+        enqueued_for_content_gen = -1;
+        return false;
+    }
+
+    // NOTE: the caller must hold a reference to desc
+    void set_content(int gen, content_hash hash, content_desc const* desc, void const* data)
+    {
+        // pinned resources hold a reference to their content
+        if (pin_count > 0)
+        {
+            if (desc)
+                desc->acquire();
+            if (content)
+                content->release();
         }
+
+        content_gen = gen;
+        content_name = hash;
+        content = desc;
+        runtime_data = data;
+        content_epoch = desc ? desc->epoch.load() : 0;
     }
-    void set(HashT hash, ValueT value)
+};
+static_assert(sizeof(res_cache) == 64, "res_cache should be exactly one cache line");
+
+// densely packed, pointer-stable storage for per-resource data (res_desc, res_cache, ref_count)
+// NOTE: entries are allocated in blocks and live as long as the table
+template <class T>
+struct block_table
+{
+    T* allocate()
     {
-        auto lock = std::unique_lock{_mutex};
-        _data[hash] = cc::move(value);
+        auto lock = std::lock_guard{_mutex};
+        return allocate_unlocked();
     }
-    void set_if_new(HashT hash, ValueT value)
+
+    // allocates count entries at once (only locks once)
+    void allocate_many(size_t count, cc::vector<T*>& out)
     {
-        auto lock = std::unique_lock{_mutex};
-        _data.get_or_create(hash, [&] { return cc::move(value); });
+        out.resize(count);
+        auto lock = std::lock_guard{_mutex};
+        for (auto& p : out)
+            p = allocate_unlocked();
     }
-    template <class MutF>
-    bool modify(HashT hash, MutF&& mut_f)
+
+    // calls f(T&) for all allocated entries
+    template <class F>
+    void for_each(F&& f)
     {
-        auto lock = std::unique_lock{_mutex};
-        auto p_data = _data.get_ptr(hash);
-        if (p_data)
+        auto lock = std::lock_guard{_mutex};
+        for (auto i : cc::indices_of(_blocks))
         {
-            mut_f(*p_data);
-            return true;
+            auto const used = i + 1 == _blocks.size() ? _used_in_last_block : block_size;
+            for (auto j = 0; j < used; ++j)
+                f(_blocks[i]->entries[j]);
         }
-        else
-            return false;
     }
 
-    // MutF: (cc::map<HashT, ValueT>&) -> void
-    template <class MutF>
-    void modify_many(MutF&& mut_f)
+private:
+    T* allocate_unlocked()
     {
-        auto lock = std::unique_lock{_mutex};
-        mut_f(_data);
+        if (_blocks.empty() || _used_in_last_block == block_size)
+        {
+            _blocks.push_back(cc::make_unique<block>());
+            _used_in_last_block = 0;
+        }
+        return &_blocks.back()->entries[_used_in_last_block++];
     }
-    // ReadF: (cc::map<HashT, ValueT> const&) -> void
-    template <class ReadF>
-    void read_many(ReadF&& read_f)
+
+    static constexpr int block_size = 1024;
+    struct block
     {
-        auto lock = std::shared_lock{_mutex};
-        read_f((cc::map<HashT, ValueT> const&)_data);
-    }
+        T entries[block_size];
+    };
 
-private:
-    cc::map<HashT, ValueT> _data;
-    std::shared_mutex _mutex;
+    std::mutex _mutex;
+    cc::vector<cc::unique_ptr<block>> _blocks;
+    int _used_in_last_block = 0;
 };
-} // namespace
-} // namespace res::base
 
-struct res::base::ResourceSystem::impl
+// pointer-stable storage for the args of all resources
+// NOTE: each allocation is contiguous, args of consecutively defined resources are adjacent
+struct res_args_table
 {
-    // TODO
+    cc::span<res_hash const> store(cc::span<res_hash const> args)
+    {
+        if (args.empty())
+            return {};
 
-    // for now, we need comp/res maps completely in memory
-    // so we know how to compute every resource
-    MemoryStore<comp_hash, computation_desc> comp_store;
-    MemoryStore<res_hash, res_desc> res_store;
+        auto lock = std::lock_guard{_mutex};
+        auto const p = allocate_unlocked(args.size());
+        std::memcpy(p, args.data(), args.size_bytes());
+        return {p, args.size()};
+    }
 
-    // these two are the "data caches"
-    MemoryStore<content_hash, content_desc> content_store;
-    MemoryStore<invoc_hash, invoc_desc> invoc_store;
+    // allocates space for count args at once (only locks once)
+    res_hash* allocate(size_t count)
+    {
+        if (count == 0)
+            return nullptr;
 
-    // queue
-    // TODO: mpmc with grow?
-    // NOTE: we have to guarantee that once a job lands in one of these queues
-    //       that eventually the stores will contain updated data
-    cc::ringbuffer<res_hash> queue_compute_content_of_resource;
-    std::mutex queue_compute_content_of_resource_mutex;
-    cc::ringbuffer<res_hash> queue_compute_content_hash_of_resource;
-    std::mutex queue_compute_content_hash_of_resource_mutex;
+        auto lock = std::lock_guard{_mutex};
+        return allocate_unlocked(count);
+    }
 
-    // content provider
-    cc::vector<cc::unique_function<cc::optional<computation_result>(content_hash)>> content_provider;
-    std::shared_mutex content_provider_mutex;
-};
+private:
+    res_hash* allocate_unlocked(size_t count)
+    {
+        // NOTE: large allocations get their own block, the current one stays active
+        if (count > block_size / 4)
+        {
+            auto& b = _large_blocks.emplace_back();
+            b.resize(count);
+            return b.data();
+        }
+
+        if (_blocks.empty() || _used_in_last_block + count > block_size)
+        {
+            _blocks.emplace_back().resize(block_size);
+            _used_in_last_block = 0;
+        }
 
-res::base::ResourceSystem::ResourceSystem() { m = cc::make_unique<impl>(); }
+        auto const p = _blocks.back().data() + _used_in_last_block;
+        _used_in_last_block += count;
+        return p;
+    }
 
-res::base::ResourceSystem::~ResourceSystem() = default;
+    static constexpr size_t block_size = 4096;
 
-res::base::comp_hash res::base::ResourceSystem::define_computation(computation_desc desc)
+    std::mutex _mutex;
+    cc::vector<cc::vector<res_hash>> _blocks; // NOTE: never resized after creation, so pointers are stable
+    cc::vector<cc::vector<res_hash>> _large_blocks;
+    size_t _used_in_last_block = 0;
+};
+
+// claims the computation of a resource for a job of the given generation (see res_desc::computing_gen)
+// returns false if a computation of this (or a newer) generation is already in flight
+bool try_claim_computation(res_entry entry, int gen)
 {
-    // make hash
-    cc::sha1_builder sha1;
-    sha1.add(cc::as_byte_span(desc.algo_hash));
-    sha1.add(cc::as_byte_span(desc.type_hash));
-    auto const hash = res::detail::finalize_as<comp_hash>(sha1);
+    auto lock = std::lock_guard{entry.cache->lock};
+    if (entry.desc->computing_gen >= gen)
+        return false;
+    entry.desc->computing_gen = gen;
+    return true;
+}
 
-    // read: check if comp already known
-    auto has_val = m->comp_store.get(hash,
-                                     [&](computation_desc const& prev_desc)
+// ends the claim of try_claim_computation (unless a newer job claimed it in the meantime)
+void release_computation(res_entry entry, int gen)
+{
+    auto lock = std::lock_guard{entry.cache->lock};
+    if (entry.desc->computing_gen == gen)
+        entry.desc->computing_gen = -1;
+}
+
+// true if the cache has up-to-date data for a job of the given generation
+bool is_ready_for(res_cache const& cache, int gen, bool need_content)
+{
+    return cache.is_valid_for(gen) && (!need_content || cache.has_content());
+}
+
+// the cache part of try_get_resource_content
+// returns the content if available (marked as outdated if not valid for gen)
+// need_enqueue is set if the caller has to enqueue the resource for content
+// NOTE: this is the fast path, it only touches the single cache line of the resource
+cc::optional<content_ref> try_get_cached_content(res_cache& cache, int gen, bool enqueue_if_not_found, priority prio, bool& need_enqueue)
+{
+    auto lock = std::lock_guard{cache.lock};
+
+    // see if cached version found
+    // NOTE: no content means only content_hash, not actual data is known
+    // NOTE: the acquire fails if the content was evicted in the meantime
+    // NOTE: valid content is up to date for the caller's generation, even if it was computed earlier
+    if (cache.is_valid_for(gen) && cache.try_acquire_content())
+        return cache.content->make_ref(gen, cache.content_name, cache.runtime_data);
+
+    // cached content is either :
+    // - outdated
+    // - computed but not cached
+    // - not computed
+    // -> if no cached data found, trigger computation
+    // NOTE: already enqueued jobs are boosted by enqueuing them again with the higher priority
+    if (enqueue_if_not_found && (!cache.is_enqueued_for(cache.enqueued_for_content_gen, gen) || prio > cache.enqueued_priority))
+    {
+        need_enqueue = true;
+        cache.enqueued_for_content_gen = cc::max(cache.enqueued_for_content_gen, gen);
+        cache.enqueued_priority = prio;
+    }
+
+    // try to return outdated data
+    if (cache.try_acquire_content())
+    {
+        auto content = cache.content->make_ref(cache.content_gen, cache.content_name, cache.runtime_data);
+        content.is_outdated = true;
+        return content;
+    }
+
+    return {};
+}
+
+// marks all given resources and their transitive dependents as dirty for the given (not yet published) generation
+// returns the number of resources that were invalidated
+// NOTE: resources that are already dirty are not traversed further
+//       because their dependents cannot have become valid in the meantime
+//       (a dependent is only valid if computed after all its args became valid)
+// NOTE: must be called under impl::dependents_mutex
+int mark_dirty(cc::span<res_entry const> roots, int gen)
+{
+    auto affected = 0;
+    cc::vector<res_entry> stack;
+    stack.push_back_range(roots);
+    while (!stack.empty())
+    {
+        auto const entry = stack.back();
+        stack.pop_back();
+
+        {
+            auto& cache = *entry.cache;
+            auto lock = std::lock_guard{cache.lock};
+
+            if (cache.dirty_gen == gen) // already visited
+                continue;
+
+            auto const was_valid = cache.content_gen >= 0 && cache.content_gen >= cache.dirty_gen;
+            cache.dirty_gen = gen;
+            if (!was_valid)
+                continue;
+        }
+
+        ++affected;
+        stack.push_back_range(entry.desc->dependents);
+    }
+    return affected;
+}
+
+// removes all waiters that are satisfied by the current cache
+// waiters that are not waiting for any other arg are moved to "ready"
+// NOTE: must be called whenever the cache is updated
+void collect_ready_waiters(res_cache& cache, cc::vector<res_wait_state*>& ready)
+{
+    if (cache.waiters == nullptr || cache.waiters->empty())
+        return;
+
+    auto& waiters = *cache.waiters;
+    size_t remaining = 0;
+    for (auto w : waiters)
+    {
+        if (!is_ready_for(cache, w->gen, w->wait_for_content))
+            waiters[remaining++] = w;
+        else if (w->missing_args.fetch_sub(1) == 1)
+            ready.push_back(w);
+    }
+    waiters.resize(remaining);
+}
+
+// stores the (up-to-date) content of a job in the cache and collects the waiters that became ready
+// NOTE: does nothing if the cache is already up to date with content (or a newer job finished in the meantime)
+void set_job_content(res_cache& cache, int gen, content_hash hash, content_desc const* content, void const* runtime_data, cc::vector<res_wait_state*>& ready)
+{
+    auto lock = std::lock_guard{cache.lock};
+    if (cache.content_gen < gen || (cache.content_gen == gen && !cache.has_content()))
+    {
+        cache.set_content(gen, hash, content, runtime_data);
+        collect_ready_waiters(cache, ready);
+    }
+}
+
+// TODO: flat?
+struct invoc_desc
+{
+    content_hash content;
+    bool is_persisted = false;
+
+    // TODO:
+    // if we had an was_loaded_from_content_provider, we could make save-to-persistence cheaper
+};
+
+// blobs of at least this size are tree hashed, smaller ones are hashed in a single pass
+constexpr size_t content_tree_hash_min_size = size_t(8) << 20;
+// size of the leaves of the tree hash
+constexpr size_t content_tree_hash_chunk_size = size_t(1) << 20;
+// number of threads that help the hashing thread with the leaves (shared by all jobs)
+constexpr int content_tree_hash_max_helpers = 4;
+
+// define_resources batches of at least this size are hashed in parallel, in blocks of this many resources
+constexpr size_t define_hash_parallel_min_count = size_t(1) << 16;
+constexpr size_t define_hash_block_size = size_t(1) << 14;
+
+// calls fn(i) for all i in [0, count), with up to max_helpers tasks on helpers assisting the calling thread
+// returns once all calls finished
+// NOTE: the calling thread takes indices as well, the helpers only pick up the remaining ones
+//       thus, a busy helper pool (e.g. with another blob) only reduces the parallelism
+// NOTE: helper tasks that only run after this returned find no indices left and never call fn
+void run_with_helpers(size_t count, executor& helpers, int max_helpers, cc::function_ref<void(size_t)> fn)
+{
+    // shared with the helper tasks, which might only run after all indices are done
+    struct shared_state
+    {
+        size_t count = 0;
+        cc::function_ref<void(size_t)> fn;
+        std::atomic<size_t> next = 0;
+        std::atomic<size_t> finished = 0;
+        std::mutex mutex;
+        std::condition_variable finished_cv;
+
+        explicit shared_state(size_t count, cc::function_ref<void(size_t)> fn) : count(count), fn(fn) {}
+
+        void run()
+        {
+            while (true)
+            {
+                auto const i = next.fetch_add(1);
+                if (i >= count)
+                    return;
+
+                fn(i);
+
+                if (finished.fetch_add(1) + 1 == count)
+                {
+                    {
+                        auto lock = std::lock_guard{mutex};
+                    }
+                    finished_cv.notify_all();
+                }
+            }
+        }
+    };
+
+    auto const state = std::make_shared<shared_state>(count, fn);
+
+    auto const helper_count = count == 0 ? 0 : cc::min(size_t(max_helpers), count - 1);
+    for (size_t i = 0; i < helper_count; ++i)
+        helpers.execute([state] { state->run(); });
+    state->run();
+
+    // indices taken by helpers might still be in progress
+    auto lock = std::unique_lock{state->mutex};
+    state->finished_cv.wait(lock, [&] { return state->finished.load() == count; });
+}
+
+// tree hash of a large blob:
+//   leaves: SHA1 of each fixed-size chunk, computed in parallel
+//   root: the given builder over blob size, chunk size, and all leaf hashes
+// NOTE: the chunk layout is fixed (and independent of the number of threads), so the hash is deterministic
+void add_tree_hashed_blob(cc::sha1_builder& root, cc::span<std::byte const> blob, executor& helpers)
+{
+    struct leaf_hash
+    {
+        std::byte data[20];
+    };
+
+    auto const chunk_count = (blob.size() + content_tree_hash_chunk_size - 1) / content_tree_hash_chunk_size;
+    cc::vector<leaf_hash> leaves;
+    leaves.resize(chunk_count);
+
+    run_with_helpers(chunk_count, helpers, content_tree_hash_max_helpers,
+                     [&](size_t i)
+                     {
+                         auto const offset = i * content_tree_hash_chunk_size;
+                         auto const size = cc::min(content_tree_hash_chunk_size, blob.size() - offset);
+
+                         cc::sha1_builder sha1;
+                         sha1.add(blob.subspan(offset, size));
+                         auto const h = sha1.finalize();
+                         static_assert(sizeof(h) == sizeof(leaf_hash));
+                         std::memcpy(&leaves[i], &h, sizeof(h));
+                     });
+
+    root.add(cc::as_byte_span(uint64_t(blob.size())));
+    root.add(cc::as_byte_span(uint64_t(content_tree_hash_chunk_size)));
+    for (auto const& l : leaves)
+        root.add(cc::as_byte_span(l));
+}
+
+// NOTE: tree_hash_helpers are only used for large blobs (see add_tree_hashed_blob)
+content_hash make_content_hash(
+    computation_result const& res, invoc_hash invoc, cc::function_ptr<content_hash(void const*)> make_hash, bool is_volatile, executor& tree_hash_helpers)
+{
+    cc::sha1_builder sha1;
+    if (res.serialized_data.has_value() && res.serialized_data.value().bytes().size() >= content_tree_hash_min_size) // large blob case
+    {
+        sha1.add(cc::as_byte_span(uint32_t(1001)));
+        add_tree_hashed_blob(sha1, res.serialized_data.value().bytes(), tree_hash_helpers);
+    }
+    else if (res.serialized_data.has_value()) // normal case
+    {
+        sha1.add(cc::as_byte_span(uint32_t(1000)));
+        sha1.add(res.serialized_data.value().bytes());
+    }
+    else if (res.error_data.has_value()) // error case
+    {
+        sha1.add(cc::as_byte_span(uint32_t(2000)));
+        sha1.add(cc::as_byte_span(res.error_data.value().message));
+    }
+    else if (res.runtime_data.size() == 1 && make_hash) // non-serializable BUT hashable case
+    {
+        sha1.add(cc::as_byte_span(uint32_t(3000)));
+        sha1.add(cc::as_byte_span(make_hash(res.runtime_data[0].data.data_ptr)));
+    }
+    else // non-serializable + non-hashable case
+    {
+        CC_ASSERT(res.runtime_data.size() == 1 && "this should not happen. if we have multiple runtime repr, it means it was serializable and the serialized data is deduplicated");
+        sha1.add(cc::as_byte_span(uint32_t(4000)));
+        sha1.add(cc::as_byte_span(invoc));
+
+        // volatile + non-serializable means we have no idea what the content is
+        // thus we add a basically random value to the hash
+        if (is_volatile)
+            sha1.add(cc::as_byte_span(std::chrono::high_resolution_clock::now().time_since_epoch().count()));
+    }
+    return res::detail::finalize_as<content_hash>(sha1);
+}
+
+// NOTE: these are threadsafe via reader/writer locks
+//       the store is split into 2^ShardBits independently locked shards
+//       the shard is selected by the upper bits of w0, which are uniformly distributed for our hashes
+//       (lower bits of w0 and bits of w1 are used by the flat_hash_map itself)
+// NOTE: callbacks must not access the same store again (could deadlock on the shard lock)
+template <class HashT, class ValueT, int ShardBits = 0>
+struct MemoryStore
+{
+    static_assert(0 <= ShardBits && ShardBits <= 16);
+    static constexpr int shard_count = 1 << ShardBits;
+
+    using map_t = res::detail::flat_hash_map<HashT, ValueT>;
+
+    static int shard_of(HashT const& hash)
+    {
+        if constexpr (ShardBits == 0)
+            return 0;
+        else
+            return int(hash.w0 >> (64 - ShardBits));
+    }
+
+    // returns an optional of get_f(ValueT const&)
+    // if get_f is void, returns a bool that is true iff get_f was called (i.e. the key exists)
+    // NOTE: get_f is called within a reader-lock
+    //       thus, there should be no expensive computation within
+    template <class GetF>
+    auto get(HashT hash, GetF&& get_f)
+    {
+        using T = std::decay_t<decltype(get_f(std::declval<ValueT const&>()))>;
+
+        auto& s = _shards[shard_of(hash)];
+
+        if constexpr (std::is_same_v<T, void>)
+        {
+            auto has_value = false;
+
+            {
+                auto lock = std::shared_lock{s.mutex};
+                if (auto p_val = s.data.get_ptr(hash))
+                {
+                    get_f(static_cast<ValueT const&>(*p_val));
+                    has_value = true;
+                }
+            }
+
+            return has_value;
+        }
+        else
+        {
+            cc::optional<T> res;
+
+            {
+                auto lock = std::shared_lock{s.mutex};
+                if (auto p_val = s.data.get_ptr(hash))
+                    res = get_f(static_cast<ValueT const&>(*p_val));
+            }
+
+            return res;
+        }
+    }
+    // calls get_f(i, ValueT const*) for each hashes[i], with nullptr if the key does not exist
+    // NOTE: the hashes are grouped by shard, so each shard is only reader-locked once
+    //       get_f is called within that lock, in shard order (not in order of hashes)
+    template <class GetF>
+    void get_many(cc::span<HashT const> hashes, GetF&& get_f)
+    {
+        static thread_local cc::vector<uint32_t> order;
+        uint32_t shard_start[shard_count + 1];
+        group_by_shard(hashes, order, shard_start);
+
+        for (auto si = 0; si < shard_count; ++si)
+        {
+            if (shard_start[si] == shard_start[si + 1])
+                continue;
+
+            auto& s = _shards[si];
+            auto lock = std::shared_lock{s.mutex};
+            for (auto oi = shard_start[si]; oi < shard_start[si + 1]; ++oi)
+            {
+                auto const i = order[oi];
+                get_f(size_t(i), static_cast<ValueT const*>(s.data.get_ptr(hashes[i])));
+            }
+        }
+    }
+    // batched version of modify_or_create: calls mut_f(i, ValueT&) for each hashes[i]
+    // after creating the value via create_f(i) if it does not exist
+    // NOTE: the hashes are grouped by shard, so each shard is only writer-locked once
+    //       both functions are called within that lock, in shard order (not in order of hashes)
+    template <class CreateF, class MutF>
+    void modify_or_create_many(cc::span<HashT const> hashes, CreateF&& create_f, MutF&& mut_f)
+    {
+        static thread_local cc::vector<uint32_t> order;
+        uint32_t shard_start[shard_count + 1];
+        group_by_shard(hashes, order, shard_start);
+
+        for (auto si = 0; si < shard_count; ++si)
+        {
+            if (shard_start[si] == shard_start[si + 1])
+                continue;
+
+            auto& s = _shards[si];
+            auto lock = std::unique_lock{s.mutex};
+            for (auto oi = shard_start[si]; oi < shard_start[si + 1]; ++oi)
+            {
+                auto const i = size_t(order[oi]);
+                mut_f(i, s.data.get_or_create(hashes[i], [&] { return create_f(i); }));
+            }
+        }
+    }
+    void set(HashT hash, ValueT value)
+    {
+        auto& s = _shards[shard_of(hash)];
+        auto lock = std::unique_lock{s.mutex};
+        s.data[hash] = cc::move(value);
+    }
+    void set_if_new(HashT hash, ValueT value)
+    {
+        auto& s = _shards[shard_of(hash)];
+        auto lock = std::unique_lock{s.mutex};
+        s.data.get_or_create(hash, [&] { return cc::move(value); });
+    }
+    template <class MutF>
+    bool modify(HashT hash, MutF&& mut_f)
+    {
+        auto& s = _shards[shard_of(hash)];
+        auto lock = std::unique_lock{s.mutex};
+        auto p_data = s.data.get_ptr(hash);
+        if (p_data)
+        {
+            mut_f(*p_data);
+            return true;
+        }
+        else
+            return false;
+    }
+    // creates the value via create_f() if it does not exist
+    // and then returns mut_f(ValueT&)
+    // both are called under the same writer lock
+    template <class CreateF, class MutF>
+    decltype(auto) modify_or_create(HashT hash, CreateF&& create_f, MutF&& mut_f)
+    {
+        auto& s = _shards[shard_of(hash)];
+        auto lock = std::unique_lock{s.mutex};
+        return mut_f(s.data.get_or_create(hash, create_f));
+    }
+
+    // MutF: (map_t&) -> void
+    // NOTE: called once per shard, each time with only that shard locked
+    template <class MutF>
+    void modify_many(MutF&& mut_f)
+    {
+        for (auto& s : _shards)
+        {
+            auto lock = std::unique_lock{s.mutex};
+            mut_f(s.data);
+        }
+    }
+    // MutF: (map_t&) -> void
+    // NOTE: only the given shard is locked, see shard_of
+    template <class MutF>
+    void modify_shard(int shard, MutF&& mut_f)
+    {
+        auto& s = _shards[shard];
+        auto lock = std::unique_lock{s.mutex};
+        mut_f(s.data);
+    }
+    // ReadF: (map_t const&) -> void
+    // NOTE: called once per shard, each time with only that shard locked
+    template <class ReadF>
+    void read_many(ReadF&& read_f)
+    {
+        for (auto& s : _shards)
+        {
+            auto lock = std::shared_lock{s.mutex};
+            read_f((map_t const&)s.data);
+        }
+    }
+
+private:
+    // counting sort of the hash indices by shard
+    // the indices of shard s are order[shard_start[s] .. shard_start[s + 1]]
+    static void group_by_shard(cc::span<HashT const> hashes, cc::vector<uint32_t>& order, uint32_t (&shard_start)[shard_count + 1])
+    {
+        std::memset(shard_start, 0, sizeof(shard_start));
+        for (auto const& h : hashes)
+            ++shard_start[shard_of(h) + 1];
+        for (auto s = 0; s < shard_count; ++s)
+            shard_start[s + 1] += shard_start[s];
+
+        uint32_t pos[shard_count];
+        std::memcpy(pos, shard_start, sizeof(pos));
+        order.resize(hashes.size());
+        for (auto i : cc::indices_of(hashes))
+            order[pos[shard_of(hashes[i])]++] = uint32_t(i);
+    }
+
+    // separate cache lines to prevent false sharing of the locks
+    struct alignas(64) shard
+    {
+        map_t data;
+        std::shared_mutex mutex;
+    };
+    shard _shards[shard_count];
+};
+
+// a pool of threads for blocking tasks (the default executor of executor_id::io)
+// NOTE: threads are only started on first use
+//       remaining tasks are still executed on destruction
+class thread_pool_executor final : public executor
+{
+public:
+    thread_pool_executor() = default;
+    explicit thread_pool_executor(int num_threads) : _thread_count(num_threads) {}
+
+    void execute(cc::unique_function<void()> task) override
+    {
+        {
+            auto lock = std::lock_guard{_mutex};
+            if (_threads.empty())
+                for (auto i = 0; i < _thread_count; ++i)
+                    _threads.emplace_back([this] { worker_main(); });
+            _tasks.push_back(cc::move(task));
+        }
+        _cv.notify_one();
+    }
+
+    // NOTE: only has an effect before the first task
+    void set_thread_count(int num_threads)
+    {
+        auto lock = std::lock_guard{_mutex};
+        _thread_count = num_threads;
+    }
+
+    ~thread_pool_executor() override
+    {
+        {
+            auto lock = std::lock_guard{_mutex};
+            _should_stop = true;
+        }
+        _cv.notify_all();
+
+        for (auto& t : _threads)
+            t.join();
+    }
+
+private:
+    void worker_main()
+    {
+        while (true)
+        {
+            cc::unique_function<void()> task;
+            {
+                auto lock = std::unique_lock{_mutex};
+                _cv.wait(lock, [&] { return _should_stop || !_tasks.empty(); });
+                if (_tasks.empty()) // stopped and drained
+                    return;
+                task = _tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::mutex _mutex; // guards everything below
+    std::condition_variable _cv;
+    cc::ringbuffer<cc::unique_function<void()>> _tasks;
+    cc::vector<std::thread> _threads;
+    int _thread_count = 4;
+    bool _should_stop = false;
+};
+} // namespace
+} // namespace res::base
+
+struct res::base::ResourceSystem::impl
+{
+    // TODO
+
+    // number of shard bits of the high-traffic stores
+    // NOTE: 64 shards keep writer contention low even with many workers
+    static constexpr int store_shard_bits = 6;
+
+    // for now, we need comp/res maps completely in memory
+    // so we know how to compute every resource
+    // NOTE: res_store only maps to the (pointer-stable) definition and cache of each resource
+    //       which are owned by the tables below
+    MemoryStore<comp_hash, computation_desc> comp_store;
+    static_assert(decltype(comp_store)::map_t::has_stable_values, "jobs use computation descs after releasing the store lock");
+    MemoryStore<res_hash, res_entry, store_shard_bits> res_store;
+    block_table<res_desc> res_descs;
+    block_table<res_cache> res_caches;
+    block_table<ref_count> res_ref_counts;
+    res_args_table res_args;
+
+    // [dirty propagation]
+    // volatile resources are the roots of invalidation
+    // dirtiness is propagated along res_desc::dependents (which only exist for volatile-dependent resources)
+    // NOTE: this also serializes invalidations
+    std::mutex dependents_mutex; // guards volatile_resources + all res_desc::dependents
+    cc::vector<res_entry> volatile_resources;
+
+    // these two are the "data caches"
+    MemoryStore<content_hash, content_desc, store_shard_bits> content_store;
+    static_assert(decltype(content_store)::map_t::has_stable_values, "res_cache stores pointers to content descs");
+    MemoryStore<invoc_hash, invoc_desc, store_shard_bits> invoc_store;
+
+    // dynamic args of the last computation of resources with dynamic args
+    // key is the invoc hash of the static args, see define_dynamic_invocation
+    MemoryStore<invoc_hash, cc::vector<res_hash>, store_shard_bits> dynamic_args_store;
+
+    // [content eviction]
+    // all resident (i.e. not evicted) contents form the ring of a CLOCK
+    // NOTE: evicted content is removed from the ring, repopulated content is added again
+    std::mutex eviction_mutex; // guards resident_contents + clock_hand
+    cc::vector<content_hash> resident_contents;
+    size_t clock_hand = 0;
+    std::atomic<int64_t> memory_usage = 0;
+    std::atomic<int64_t> memory_budget = -1;
+
+    // queue
+    // NOTE: we have to guarantee that once a job lands in one of these queues
+    //       that eventually the stores will contain updated data
+    //       (mpmc_queue::push never fails and spills into a growing buffer if necessary)
+    // NOTE: a resource can be in several queues at once (e.g. when boosted to a higher priority)
+    //       the later jobs then take the early out
+    struct job_queues
+    {
+        res::detail::mpmc_queue<res_hash> content;
+        res::detail::mpmc_queue<res_hash> content_hash;
+
+        // how often jobs of a higher priority were processed while this level had jobs
+        // reset whenever a job of this level is processed (see impl_process_any_job)
+        std::atomic<int> skipped = 0;
+
+        bool empty_approx() const { return content.empty_approx() && content_hash.empty_approx(); }
+    };
+    job_queues queues[priority_count]; // indexed by priority
+    res::detail::mpmc_queue<res_wait_state*> queue_callbacks; // see notify_when_content_available
+
+    // a level that was skipped this often is served before all higher levels
+    static constexpr int starvation_limit = 16;
+
+    // worker pool
+    // NOTE: pending_jobs counts queued AND in-flight jobs
+    //       a job is only finished after all follow-up jobs (e.g. requeues) are enqueued
+    //       thus, pending_jobs == 0 means that the system is idle
+    cc::vector<std::thread> workers;
+    std::mutex workers_mutex; // guards workers + workers_should_stop, used for both condition variables
+    std::condition_variable workers_cv; // new jobs or stop request
+    std::condition_variable idle_cv;    // pending_jobs reached zero
+    bool workers_should_stop = false;
+    std::atomic<int> queued_jobs = 0;
+    std::atomic<int> pending_jobs = 0;
+    // workers only take workers_mutex to sleep
+    // producers only need to lock + notify if any worker is sleeping
+    std::atomic<int> sleeping_workers = 0;
+    // same for threads waiting in process_until_idle, which also help with new jobs
+    // NOTE: jobs can be enqueued from other threads, e.g. by tasks on the io executor
+    std::atomic<int> idle_waiters = 0;
+
+    void wake_idle_waiters()
+    {
+        if (idle_waiters.load() > 0)
+        {
+            {
+                auto lock = std::lock_guard{workers_mutex};
+            }
+            idle_cv.notify_all();
+        }
+    }
+
+    // [executors]
+    // NOTE: cpu and main_thread are built-in and have no entry
+    std::shared_mutex executors_mutex; // guards executors (held while submitting tasks)
+    cc::unique_ptr<executor> executors[max_executor_count];
+    thread_pool_executor* io_pool = nullptr; // the default io executor (owned by executors)
+
+    // helpers for hashing large contents and large define_resources batches, shared by all jobs (see run_with_helpers)
+    // NOTE: only starts its threads on the first large content (or batch)
+    thread_pool_executor tree_hash_pool{content_tree_hash_max_helpers};
+
+    // computations of executor_id::main_thread, see process_main_thread_jobs
+    std::mutex main_thread_jobs_mutex;
+    cc::vector<cc::unique_function<void()>> main_thread_jobs;
+    std::atomic<int> queued_main_thread_jobs = 0;
+
+    // set by ~ResourceSystem, computations that did not start yet are cancelled instead
+    std::atomic<bool> is_shutting_down = false;
+
+    // content provider
+    // NOTE: providers are called with the reader lock held, so removing one waits for running calls
+    struct content_provider_entry
+    {
+        content_provider_id id;
+        cc::unique_function<cc::optional<computation_result>(content_hash)> provider;
+    };
+    cc::vector<content_provider_entry> content_provider;
+    std::shared_mutex content_provider_mutex;
+    std::atomic<bool> has_content_providers = false;
+    content_provider_id next_content_provider_id = 0;
+
+    // immutable invoc layers below the invoc store (see add_invoc_layer)
+    // NOTE: same as for content providers, the reader lock is held during lookups
+    cc::vector<invoc_layer const*> invoc_layers;
+    std::shared_mutex invoc_layers_mutex;
+    std::atomic<bool> has_invoc_layers = false;
+
+    cc::optional<content_hash> find_in_invoc_layers(invoc_hash invoc)
+    {
+        if (!has_invoc_layers.load())
+            return cc::nullopt;
+
+        auto lock = std::shared_lock{invoc_layers_mutex};
+        for (auto const layer : invoc_layers)
+            if (auto content = layer->find(invoc); content.has_value())
+                return content;
+        return cc::nullopt;
+    }
+
+    // dirty log of newly computed persisted invocations (see drain_new_persistent_invocations)
+    // NOTE: only recorded after the first drain, otherwise nobody would ever clear it
+    std::atomic<bool> is_recording_persistent_invocs = false;
+    std::mutex new_persistent_invocs_mutex;
+    cc::vector<cc::pair<invoc_hash, content_hash>> new_persistent_invocs;
+
+    // contents that no content provider could provide, so jobs compute them instead of asking again
+    // NOTE: a content is removed once it's stored, i.e. providers are asked again after it was evicted
+    std::mutex provider_misses_mutex;
+    res::detail::flat_hash_map<content_hash, bool> provider_misses;
+    std::atomic<int> provider_miss_count = 0;
+
+    bool is_provider_miss(content_hash hash)
+    {
+        if (provider_miss_count.load() == 0)
+            return false;
+
+        auto lock = std::lock_guard{provider_misses_mutex};
+        return provider_misses.contains_key(hash);
+    }
+    void add_provider_miss(content_hash hash)
+    {
+        auto lock = std::lock_guard{provider_misses_mutex};
+        if (!provider_misses.contains_key(hash))
+        {
+            provider_misses[hash] = true;
+            provider_miss_count.fetch_add(1);
+        }
+    }
+    void remove_provider_miss(content_hash hash)
+    {
+        if (provider_miss_count.load() == 0)
+            return;
+
+        auto lock = std::lock_guard{provider_misses_mutex};
+        if (provider_misses.remove_key(hash))
+            provider_miss_count.fetch_sub(1);
+    }
+
+    // returns the definition and cache of a resource
+    // returns empty pointers if the resource is unknown
+    // NOTE: only briefly locks the shard, the returned pointers stay valid
+    res_entry lookup_res(res_hash res)
+    {
+        auto entry = res_store.get(res, [](res_entry const& e) { return e; });
+        return entry.has_value() ? entry.value() : res_entry{};
+    }
+
+    // true if the resource is referenced
+    // or if a job of a referenced resource (or a callback) is waiting for it, directly or transitively
+    // NOTE: conservative, a resource that was just needed might still count as needed
+    bool is_needed(res_entry root)
+    {
+        auto const is_witness = [](ref_count const* c) { return c != nullptr && c->is_referenced(); };
+
+        // fast path: referenced or recently needed
+        if (root.desc->ref_counter->is_referenced() || is_witness(root.desc->needed_witness.load(std::memory_order_relaxed)))
+            return true;
+
+        // search along the waiters for a needed resource
+        // NOTE: most unreferenced resources are only waited for by a single referenced resource
+        res::detail::flat_hash_map<res_hash, bool> visited;
+        cc::vector<res_entry> stack;
+        cc::vector<res_hash> waiting;
+        stack.push_back(root);
+        while (!stack.empty())
+        {
+            auto const entry = stack.back();
+            stack.pop_back();
+
+            waiting.clear();
+            {
+                auto& cache = *entry.cache;
+                auto lock = std::lock_guard{cache.lock};
+                if (cache.waiters != nullptr)
+                    for (auto w : *cache.waiters)
+                    {
+                        if (w->callback) // someone waits for the content itself
+                            return true;
+                        waiting.push_back(w->res);
+                    }
+            }
+
+            for (auto const& r : waiting)
+            {
+                if (visited.contains_key(r))
+                    continue;
+                visited[r] = true;
+
+                auto const e = lookup_res(r);
+                CC_ASSERT(e.desc != nullptr);
+                ref_count const* witness = e.desc->ref_counter;
+                if (!is_witness(witness))
+                    witness = e.desc->needed_witness.load(std::memory_order_relaxed);
+
+                if (is_witness(witness))
+                {
+                    root.desc->needed_witness.store(witness, std::memory_order_relaxed);
+                    return true;
+                }
+
+                stack.push_back(e);
+            }
+        }
+
+        return false;
+    }
+};
+
+res::base::ResourceSystem::ResourceSystem()
+{
+    m = cc::make_unique<impl>();
+
+    auto io_pool = cc::make_unique<thread_pool_executor>();
+    m->io_pool = io_pool.get();
+    m->executors[int(executor_id::io)] = cc::move(io_pool);
+}
+
+res::base::ResourceSystem::~ResourceSystem()
+{
+    stop_workers();
+
+    // computations queued on executors (or for the main thread) are cancelled when they run
+    // NOTE: executors might still complete computations, the thread pools drain their tasks on destruction
+    m->is_shutting_down = true;
+    for (auto& e : m->executors)
+        e = nullptr;
+    process_main_thread_jobs();
+
+    // callbacks that were never executed (see notify_when_content_available)
+    for (res_wait_state* w; m->queue_callbacks.try_pop(w);)
+        cc::free(w);
+
+    // jobs that still wait for args
+    // NOTE: a waiter is registered at each of its missing args, so it is freed with its last registration
+    m->res_caches.for_each(
+        [](res_cache& cache)
+        {
+            if (cache.waiters == nullptr)
+                return;
+            for (auto w : *cache.waiters)
+                if (w->missing_args.fetch_sub(1) == 1)
+                    cc::free(w);
+            cache.waiters = nullptr;
+        });
+}
+
+res::base::comp_hash res::base::ResourceSystem::define_computation(computation_desc desc)
+{
+    // make hash
+    res::detail::hash_builder builder;
+    builder.add(cc::as_byte_span(desc.algo_hash));
+    builder.add(cc::as_byte_span(desc.type_hash));
+    auto const hash = res::detail::finalize_as<comp_hash>(builder);
+
+    // read: check if comp already known
+    auto has_val = m->comp_store.get(hash,
+                                     [&](computation_desc const& prev_desc)
                                      {
                                          // TODO: more?
                                          if (prev_desc.algo_hash != desc.algo_hash)
@@ -341,550 +1518,1780 @@ res::base::comp_hash res::base::ResourceSystem::define_computation(computation_d
                                              LOG_WARN("computation with inconsistent type hash");
                                      });
 
-    // write: add to map
-    if (!has_val)
+    // write: add to map
+    if (!has_val)
+    {
+        LOG_VERBOSE("comp %s defined", shorthash(hash));
+        m->comp_store.set(hash, cc::move(desc));
+    }
+
+    return hash;
+}
+
+cc::pair<res::base::res_hash, res::base::ref_count*> res::base::ResourceSystem::define_resource(resource_desc const& desc)
+{
+    CC_ASSERT(!(desc.is_volatile && desc.is_persisted) && "persisted volatile does not make sense. we would just senselessly write data to disk");
+
+    ref_count* counter = nullptr;
+
+    // make hash
+    res::detail::hash_builder builder;
+    builder.add(cc::as_byte_span(desc.computation));
+    for (auto const& h : desc.args)
+        builder.add(cc::as_byte_span(h));
+    auto const hash = res::detail::finalize_as<res_hash>(builder);
+
+    // read: check if res already known
+    // NOTE: the definition is immutable, so no lock is needed after the lookup
+    if (auto const prev = m->lookup_res(hash); prev.desc != nullptr)
+    {
+        CC_ASSERT(desc.computation == prev.desc->comp && "res_hash collision");
+        CC_ASSERT(desc.args.equals_content(prev.desc->args) && "res_hash collision");
+        CC_ASSERT(desc.deserialize == prev.desc->deserialize && "res_hash collision");
+
+        prev.desc->ref_counter->inc();
+        return {hash, prev.desc->ref_counter};
+    }
+
+    // only resources that can become dirty need to be part of the dependents graph
+    // NOTE: looked up beforehand because the store must not be accessed in modify_or_create
+    cc::vector<res_desc*> volatile_args;
+    for (auto const& a : desc.args)
+        if (auto const arg = m->lookup_res(a); arg.desc != nullptr && arg.desc->depends_on_volatile)
+            volatile_args.push_back(arg.desc);
+    // NOTE: dynamic args are unknown here, so those resources are always tracked
+    auto const depends_on_volatile = desc.is_volatile || desc.has_dynamic_args || !volatile_args.empty();
+
+    // NOTE: the dependents are registered before the resource is visible
+    //       so that no invalidation can be missed
+    auto dependents_lock = std::unique_lock(m->dependents_mutex, std::defer_lock);
+    if (depends_on_volatile)
+        dependents_lock.lock();
+
+    // write: add to map
+    // NOTE: someone else might have defined it in the meantime
+    auto is_new = false;
+    m->res_store.modify_or_create(
+        hash,
+        [&]
+        {
+            is_new = true;
+
+            auto rdesc = m->res_descs.allocate();
+            rdesc->comp = desc.computation;
+            rdesc->args = m->res_args.store(desc.args);
+            rdesc->is_volatile = desc.is_volatile;
+            rdesc->is_persisted = desc.is_persisted;
+            rdesc->has_dynamic_args = desc.has_dynamic_args;
+            rdesc->depends_on_volatile = depends_on_volatile;
+            rdesc->ref_counter = m->res_ref_counts.allocate();
+            rdesc->deserialize = desc.deserialize;
+
+            auto const entry = res_entry{rdesc, m->res_caches.allocate()};
+
+            if (depends_on_volatile)
+            {
+                if (desc.is_volatile)
+                    m->volatile_resources.push_back(entry);
+
+                for (auto const arg : volatile_args)
+                    arg->dependents.push_back(entry);
+            }
+
+            return entry;
+        },
+        [&](res_entry const& entry)
+        {
+            counter = entry.desc->ref_counter;
+            if (!is_new) // defined by someone else in the meantime
+                counter->inc();
+        });
+
+#if ENABLE_VERBOSE_LOG
+    if (is_new)
+    {
+        cc::string deps;
+        for (auto a : desc.args)
+        {
+            if (!deps.empty())
+                deps += ", ";
+            deps += shorthash(a);
+        }
+        LOG_VERBOSE("res %s defined, deps [%s]", shorthash(hash), deps);
+    }
+#else
+    (void)is_new;
+#endif
+
+    CC_ASSERT(counter != nullptr);
+    return {hash, counter};
+}
+
+void res::base::ResourceSystem::define_resources(cc::span<resource_desc const> descs, cc::span<cc::pair<res_hash, ref_count*>> out)
+{
+    CC_ASSERT(descs.size() == out.size() && "one output per resource required");
+    auto const count = descs.size();
+    if (count == 0)
+        return;
+
+    // 1. make all hashes
+    //    (same as define_resource: hash of comp ++ args)
+    //    large batches are split into blocks that are hashed in parallel (see define_hash_parallel_min_count)
+    cc::vector<res_hash> hashes;
+    hashes.resize(count);
+    auto const hash_blocks = [&](cc::function_ref<void(size_t, size_t)> hash_range)
+    {
+        if (count < define_hash_parallel_min_count)
+        {
+            hash_range(0, count);
+            return;
+        }
+
+        auto const block_count = (count + define_hash_block_size - 1) / define_hash_block_size;
+        run_with_helpers(block_count, m->tree_hash_pool, content_tree_hash_max_helpers,
+                         [&](size_t b)
+                         {
+                             auto const begin = b * define_hash_block_size;
+                             hash_range(begin, cc::min(begin + define_hash_block_size, count));
+                         });
+    };
+#if RES_HASH_BACKEND_SHA1
+    hash_blocks(
+        [&](size_t begin, size_t end)
+        {
+            for (auto i = begin; i < end; ++i)
+            {
+                res::detail::hash_builder builder;
+                builder.add(cc::as_byte_span(descs[i].computation));
+                for (auto const& h : descs[i].args)
+                    builder.add(cc::as_byte_span(h));
+                hashes[i] = res::detail::finalize_as<res_hash>(builder);
+            }
+        });
+#else
+    // the keys of a block are hashed at once, so that the independent hash computations are interleaved
+    // NOTE: comp and args are stored contiguously, so each key is a single input (see hash_many)
+    cc::vector<hash> keys;
+    {
+        size_t key_count = 0;
+        for (auto const& desc : descs)
+            key_count += 1 + desc.args.size();
+        keys.reserve(key_count);
+    }
+    for (auto const& desc : descs)
+    {
+        keys.push_back(desc.computation);
+        for (auto const& h : desc.args)
+            keys.push_back(h);
+    }
+
+    cc::vector<cc::span<std::byte const>> inputs;
+    inputs.resize(count);
+    size_t key_offset = 0;
+    for (auto i : cc::indices_of(descs))
+    {
+        auto const key_size = 1 + descs[i].args.size();
+        inputs[i] = cc::as_byte_span(cc::span<hash const>(keys).subspan(key_offset, key_size));
+        key_offset += key_size;
+    }
+
+    cc::vector<hash> key_hashes;
+    key_hashes.resize(count);
+    hash_blocks(
+        [&](size_t begin, size_t end)
+        {
+            res::detail::hash_many(cc::span<cc::span<std::byte const> const>(inputs).subspan(begin, end - begin),
+                                   cc::span<hash>(key_hashes).subspan(begin, end - begin));
+        });
+    for (auto i : cc::indices_of(descs))
+        static_cast<hash&>(hashes[i]) = key_hashes[i];
+#endif
+
+    // 2. read: check which resources are already known
+    cc::vector<res_entry> entries;
+    entries.resize(count);
+    m->res_store.get_many(hashes, [&](size_t i, res_entry const* e) { entries[i] = e ? *e : res_entry{}; });
+
+    // 3. collect unknown resources
+    // NOTE: duplicates within the batch are resolved when writing to the store
+    cc::vector<size_t> new_indices; // into descs
+    cc::vector<res_hash> new_hashes;
+    size_t new_args_count = 0;
+    for (auto i : cc::indices_of(descs))
+    {
+        auto const& desc = descs[i];
+        CC_ASSERT(!(desc.is_volatile && desc.is_persisted) && "persisted volatile does not make sense. we would just senselessly write data to disk");
+
+        if (auto const prev = entries[i]; prev.desc != nullptr)
+        {
+            CC_ASSERT(desc.computation == prev.desc->comp && "res_hash collision");
+            CC_ASSERT(desc.args.equals_content(prev.desc->args) && "res_hash collision");
+            CC_ASSERT(desc.deserialize == prev.desc->deserialize && "res_hash collision");
+            continue;
+        }
+
+        new_indices.push_back(i);
+        new_hashes.push_back(hashes[i]);
+        new_args_count += desc.args.size();
+    }
+
+    // 4. build all new definitions from contiguous blocks
+    // NOTE: definitions that end up unused (duplicates, concurrently defined) are not reclaimed
+    auto const new_count = new_indices.size();
+    cc::vector<res_desc*> new_descs;
+    cc::vector<res_cache*> new_caches;
+    cc::vector<ref_count*> new_counters;
+    m->res_descs.allocate_many(new_count, new_descs);
+    m->res_caches.allocate_many(new_count, new_caches);
+    m->res_ref_counts.allocate_many(new_count, new_counters);
+    auto p_args = m->res_args.allocate(new_args_count);
+
+    // only resources that can become dirty need to be part of the dependents graph
+    // all args of new resources are looked up at once
+    // NOTE: args that are only defined in this batch count as non-volatile
+    cc::vector<res_hash> arg_hashes;
+    arg_hashes.reserve(new_args_count);
+    for (auto i : new_indices)
+        arg_hashes.push_back_range(descs[i].args);
+    cc::vector<res_desc*> arg_descs;
+    arg_descs.resize(arg_hashes.size());
+    m->res_store.get_many(arg_hashes, [&](size_t i, res_entry const* e) { arg_descs[i] = e ? e->desc : nullptr; });
+
+    auto any_depends_on_volatile = false;
+    size_t arg_offset = 0;
+    for (auto j : cc::indices_of(new_indices))
+    {
+        auto const& desc = descs[new_indices[j]];
+
+        auto rdesc = new_descs[j];
+        rdesc->comp = desc.computation;
+        rdesc->args = {p_args + arg_offset, desc.args.size()};
+        if (!desc.args.empty())
+            std::memcpy(p_args + arg_offset, desc.args.data(), desc.args.size_bytes());
+        rdesc->is_volatile = desc.is_volatile;
+        rdesc->is_persisted = desc.is_persisted;
+        rdesc->has_dynamic_args = desc.has_dynamic_args;
+        rdesc->ref_counter = new_counters[j];
+        rdesc->deserialize = desc.deserialize;
+
+        // NOTE: dynamic args are unknown here, so those resources are always tracked
+        rdesc->depends_on_volatile = desc.is_volatile || desc.has_dynamic_args;
+        for (auto a : cc::span<res_desc* const>(arg_descs).subspan(arg_offset, desc.args.size()))
+            if (a != nullptr && a->depends_on_volatile)
+                rdesc->depends_on_volatile = true;
+        any_depends_on_volatile = any_depends_on_volatile || rdesc->depends_on_volatile;
+
+        arg_offset += desc.args.size();
+    }
+
+    // NOTE: the dependents are registered before any invalidation can see the new resources (see define_resource)
+    auto dependents_lock = std::unique_lock(m->dependents_mutex, std::defer_lock);
+    if (any_depends_on_volatile)
+        dependents_lock.lock();
+
+    // 5. write: add to map, one writer lock per shard
+    // NOTE: duplicates in the batch (or concurrent definitions) find the existing entry
+    cc::vector<res_entry> new_entries;
+    cc::vector<bool> is_new;
+    new_entries.resize(new_count);
+    is_new.resize(new_count);
+    m->res_store.modify_or_create_many(
+        new_hashes,
+        [&](size_t j)
+        {
+            is_new[j] = true;
+            return res_entry{new_descs[j], new_caches[j]};
+        },
+        [&](size_t j, res_entry const& entry) { new_entries[j] = entry; });
+
+    if (any_depends_on_volatile)
+    {
+        arg_offset = 0;
+        for (auto j : cc::indices_of(new_entries))
+        {
+            auto const entry = new_entries[j];
+            auto const arg_count = entry.desc->args.size();
+            if (is_new[j] && entry.desc->depends_on_volatile)
+            {
+                if (entry.desc->is_volatile)
+                    m->volatile_resources.push_back(entry);
+
+                for (auto a : cc::span<res_desc* const>(arg_descs).subspan(arg_offset, arg_count))
+                    if (a != nullptr && a->depends_on_volatile)
+                        a->dependents.push_back(entry);
+            }
+            arg_offset += arg_count;
+        }
+    }
+
+    // 6. each definition returns one reference (see define_resource)
+    for (auto i : cc::indices_of(descs))
+        if (entries[i].desc != nullptr)
+        {
+            entries[i].desc->ref_counter->inc();
+            out[i] = {hashes[i], entries[i].desc->ref_counter};
+        }
+    for (auto j : cc::indices_of(new_entries))
+    {
+        // new counters start with one reference
+        auto const counter = new_entries[j].desc->ref_counter;
+        if (!is_new[j])
+            counter->inc();
+        out[new_indices[j]] = {new_hashes[j], counter};
+    }
+
+    LOG_VERBOSE("defined %s resources (%s new)", count, new_count);
+}
+
+cc::optional<res::base::content_ref> res::base::ResourceSystem::try_get_resource_content(res_hash res, bool enqueue_if_not_found, priority prio)
+{
+    int const target_generation = generation;
+
+    auto const entry = m->lookup_res(res);
+    if (entry.cache == nullptr)
+    {
+        LOG_ERROR("no resource known with id %s", shorthash(res));
+        return {};
+    }
+
+    auto need_enqueue = false;
+    auto result = try_get_cached_content(*entry.cache, target_generation, enqueue_if_not_found, prio, need_enqueue);
+
+    // actually enqueue
+    if (need_enqueue)
+    {
+        LOG_VERBOSE("res %s enqueued for content", shorthash(res));
+        impl_enqueue_res(res, true, prio);
+    }
+
+    if (!result.has_value())
+        LOG_VERBOSE("no content available for res %s", shorthash(res));
+
+    // NOTE: result can be outdated
+    return result;
+}
+
+int res::base::ResourceSystem::try_get_resource_contents(cc::span<res_hash const> res,
+                                                         cc::span<cc::optional<content_ref>> out_contents,
+                                                         bool enqueue_if_not_found,
+                                                         priority prio)
+{
+    CC_ASSERT(res.size() == out_contents.size() && "one output per resource required");
+    int const target_generation = generation;
+
+    static thread_local cc::vector<res_entry> entries;
+    static thread_local cc::vector<res_hash> misses;
+    entries.resize(res.size());
+    misses.clear();
+
+    // one reader lock per shard instead of one per resource
+    m->res_store.get_many(res, [&](size_t i, res_entry const* e) { entries[i] = e ? *e : res_entry{}; });
+
+    auto available = 0;
+    for (auto i : cc::indices_of(res))
+    {
+        if (entries[i].cache == nullptr)
+        {
+            LOG_ERROR("no resource known with id %s", shorthash(res[i]));
+            out_contents[i] = {};
+            continue;
+        }
+
+        auto need_enqueue = false;
+        out_contents[i] = try_get_cached_content(*entries[i].cache, target_generation, enqueue_if_not_found, prio, need_enqueue);
+        if (need_enqueue)
+            misses.push_back(res[i]);
+        if (out_contents[i].has_value())
+            ++available;
+    }
+
+    // all misses are enqueued at once
+    if (!misses.empty())
+    {
+        LOG_VERBOSE("%s of %s resources enqueued for content", misses.size(), res.size());
+        impl_enqueue_res_many(misses, true, prio);
+    }
+
+    // NOTE: contents can be outdated
+    return available;
+}
+
+cc::optional<res::base::content_hash> res::base::ResourceSystem::try_get_resource_content_hash(res_hash res, bool enqueue_if_not_found, priority prio)
+{
+    auto need_enqueue = false;
+    int const target_generation = generation;
+
+    auto const entry = m->lookup_res(res);
+    if (entry.cache == nullptr)
+    {
+        LOG_ERROR("no resource known with id %s", shorthash(res));
+        return {};
+    }
+
+    {
+        auto& cache = *entry.cache;
+        auto lock = std::lock_guard{cache.lock};
+
+        // see if cached version found
+        if (cache.is_valid_for(target_generation))
+            return cache.content_name;
+
+        // otherwise check if already enqueued (with at least this priority)
+        // NOTE: enqueued for content will also set name
+        auto const is_enqueued = cache.is_enqueued_for(cache.enqueued_for_content_gen, target_generation)
+                                 || cache.is_enqueued_for(cache.enqueued_for_name_gen, target_generation);
+        if (enqueue_if_not_found && (!is_enqueued || prio > cache.enqueued_priority))
+        {
+            need_enqueue = true;
+            cache.enqueued_for_name_gen = cc::max(cache.enqueued_for_name_gen, target_generation);
+            cache.enqueued_priority = prio;
+        }
+    }
+
+    // actually enqueue
+    if (need_enqueue)
+    {
+        LOG_VERBOSE("res %s enqueued for hash", shorthash(res));
+        impl_enqueue_res(res, false, prio);
+    }
+
+    return {};
+}
+
+res::base::detail::content_desc const* res::base::ResourceSystem::set_and_get_content_if_new(content_hash hash, computation_result comp_result)
+{
+    m->remove_provider_miss(hash);
+
+    auto is_new = false;
+    auto resident_size = int64_t(0);
+
+    // for the combined semantics, we use modify_or_create here
+    // NOTE: acquiring under the writer lock guarantees that the content is not evicted in between
+    auto const desc = m->content_store.modify_or_create(
+        hash,
+        [&]
+        {
+            is_new = true;
+            return cc::move(comp_result);
+        },
+        [&](content_desc& desc)
+        {
+            if (desc.is_evicted())
+            {
+                LOG_VERBOSE("content %s is repopulated", shorthash(hash));
+                desc.repopulate(cc::move(comp_result));
+                is_new = true;
+            }
+            if (is_new)
+                resident_size = desc.size_bytes.load();
+
+            desc.acquire();
+            return &desc;
+        });
+
+    if (is_new)
+        impl_on_content_resident(hash, resident_size);
+
+    return desc;
+}
+
+void res::base::ResourceSystem::impl_on_content_resident(content_hash hash, int64_t size_bytes)
+{
+    auto const usage = m->memory_usage.fetch_add(size_bytes) + size_bytes;
+
+    {
+        auto lock = std::lock_guard(m->eviction_mutex);
+        m->resident_contents.push_back(hash);
+    }
+
+    auto const budget = m->memory_budget.load();
+    if (budget >= 0 && usage > budget)
+        impl_evict_content(budget, true);
+}
+
+int64_t res::base::ResourceSystem::impl_evict_content(int64_t target_bytes, bool second_chance)
+{
+    auto lock = std::lock_guard(m->eviction_mutex);
+    auto& ring = m->resident_contents;
+
+    int64_t freed = 0;
+
+    // two rounds are enough to clear all access bits
+    auto max_steps = 2 * ring.size();
+    while (!ring.empty() && max_steps-- > 0 && m->memory_usage.load() > target_bytes)
+    {
+        if (m->clock_hand >= ring.size())
+            m->clock_hand = 0;
+
+        auto const hash = ring[m->clock_hand];
+        auto evicted = false;
+
+        // NOTE: the writer lock prevents concurrent try_acquire in query_content and repopulation
+        //       references acquired via res_cache are detected by the refcount + epoch
+        auto const found = m->content_store.modify(hash,
+                                                   [&](content_desc& desc)
+                                                   {
+                                                       if (desc.is_evicted())
+                                                       {
+                                                           evicted = true;
+                                                           return;
+                                                       }
+
+                                                       if (second_chance && desc.was_accessed.exchange(false))
+                                                           return;
+
+                                                       if (auto const size = desc.try_evict(); size >= 0)
+                                                       {
+                                                           LOG_VERBOSE("content %s evicted (%s bytes)", shorthash(hash), size);
+                                                           m->memory_usage.fetch_sub(size);
+                                                           freed += size;
+                                                           evicted = true;
+                                                       }
+                                                   });
+
+        if (evicted || !found)
+        {
+            ring[m->clock_hand] = ring.back();
+            ring.pop_back();
+        }
+        else
+            ++m->clock_hand;
+    }
+
+    return freed;
+}
+
+void res::base::ResourceSystem::set_memory_budget(int64_t budget_bytes)
+{
+    m->memory_budget = budget_bytes;
+
+    if (budget_bytes >= 0 && m->memory_usage.load() > budget_bytes)
+        impl_evict_content(budget_bytes, true);
+}
+
+int64_t res::base::ResourceSystem::get_memory_budget() const { return m->memory_budget.load(); }
+
+int64_t res::base::ResourceSystem::get_memory_usage() const { return m->memory_usage.load(); }
+
+int64_t res::base::ResourceSystem::evict_unused_content() { return impl_evict_content(0, false); }
+
+void res::base::ResourceSystem::pin_resource(res_hash res)
+{
+    auto const entry = m->lookup_res(res);
+    if (entry.cache == nullptr)
+    {
+        LOG_ERROR("no resource known with id %s", shorthash(res));
+        return;
+    }
+
+    auto& cache = *entry.cache;
+    auto lock = std::lock_guard{cache.lock};
+
+    // first pin: the weak content reference becomes strong (if still valid)
+    // NOTE: content computed later is acquired in set_content
+    CC_ASSERT(cache.pin_count < 0xFFFF && "too many pins");
+    if (cache.pin_count++ == 0)
+        cache.try_acquire_content();
+}
+
+void res::base::ResourceSystem::unpin_resource(res_hash res)
+{
+    auto const entry = m->lookup_res(res);
+    if (entry.cache == nullptr)
     {
-        LOG_VERBOSE("comp %s defined", shorthash(hash));
-        m->comp_store.set(hash, cc::move(desc));
+        LOG_ERROR("no resource known with id %s", shorthash(res));
+        return;
     }
 
-    return hash;
+    auto& cache = *entry.cache;
+    auto lock = std::lock_guard{cache.lock};
+    CC_ASSERT(cache.pin_count > 0 && "unbalanced unpin_resource");
+
+    if (--cache.pin_count == 0 && cache.content != nullptr)
+        cache.content->release();
 }
 
-cc::pair<res::base::res_hash, res::base::ref_count*> res::base::ResourceSystem::define_resource(resource_desc const& desc)
+bool res::base::ResourceSystem::impl_process_queue_res(bool need_content, priority prio)
 {
-    CC_ASSERT(!(desc.is_volatile && desc.is_persisted) && "persisted volatile does not make sense. we would just senselessly write data to disk");
+    res_hash res;
 
-    ref_count* counter = nullptr;
+    // local caches
+    static thread_local cc::vector<res_hash> missing_args;
+    static thread_local cc::vector<content_hash> args_content_hashes;
+    static thread_local cc::vector<content_ref> args_content;
 
-    // make hash
-    cc::sha1_builder sha1;
-    sha1.add(cc::as_byte_span(desc.computation));
-    for (auto const& h : desc.args)
-        sha1.add(cc::as_byte_span(h));
-    auto const hash = res::detail::finalize_as<res_hash>(sha1);
+    auto& queues = m->queues[int(prio)];
+    auto& queue = need_content ? queues.content : queues.content_hash;
 
-    // read: check if comp already known
-    auto has_val = m->res_store.get(hash,
-                                    [&](res_desc const& prev_desc)
-                                    {
-                                        CC_ASSERT(desc.computation == prev_desc.comp && "res_hash collision");
-                                        CC_ASSERT(desc.args.equals_content(prev_desc.args) && "res_hash collision");
-                                        CC_ASSERT(desc.deserialize == prev_desc.deserialize && "res_hash collision");
+    // get job
+    if (!queue.try_pop(res))
+        return false;
+    m->queued_jobs.fetch_sub(1);
 
-                                        counter = prev_desc.ref_counter;
-                                    });
+    // process
+    //   we have a resource "res"
+    //   and want to know the content hash for it
+    // LOG("res %s processing...", shorthash(res));
 
-    // write: add to map
-    if (!has_val)
+    // 1. get comp + arg res_hashes
+    //   (can check if resource already up to date)
+    int const gen = generation;
+    auto const entry = m->lookup_res(res);
+    CC_ASSERT(entry.desc != nullptr && "overzealous GC?");
+    auto& cache = *entry.cache;
+
+    // early out: someone already updated the content (or is computing it)
+    {
+        auto lock = std::lock_guard{cache.lock};
+        if (cache.is_valid_for(gen) && (!need_content || cache.has_content()))
+            return true;
+        if (entry.desc->computing_gen >= gen)
+            return true;
+    }
+
+    // cancellation: nobody needs the result anymore
+    if (!m->is_needed(entry))
+    {
+        LOG_VERBOSE("res %s is not needed anymore, job cancelled", shorthash(res));
+        impl_cancel_job(res);
+        return true;
+    }
+
+    // NOTE: the definition is immutable, no copies or locks required
+    auto const& def = *entry.desc;
+    auto const comp = def.comp;
+    auto const args = cc::span<res_hash const>(def.args);
+    auto const is_volatile = def.is_volatile;
+    auto const is_persisted = def.is_persisted;
+    auto const has_dynamic_args = def.has_dynamic_args;
+    auto const deserialize = def.deserialize;
+
+    // 2. query content hashes for all args
+    //    (this also enqueues missing ones, with the priority of this job)
+    missing_args.clear();
+    args_content_hashes.resize(args.size());
+    for (auto i : cc::indices_of(args))
+    {
+        if (auto arg_hash = this->try_get_resource_content_hash(args[i], true, prio); arg_hash.has_value())
+            args_content_hashes[i] = arg_hash.value();
+        else
+            missing_args.push_back(args[i]);
+    }
+
+    // not all args available? wait for them
+    if (!missing_args.empty())
+    {
+        LOG_VERBOSE("res %s waits because not all arg hashes are available", shorthash(res));
+        impl_wait_for_args(res, gen, need_content, false, prio, missing_args);
+        return true;
+    }
+
+    // read cached invocation data
+    auto const invoc = this->define_invocation(comp, args_content_hashes);
+
+    // resources with dynamic args: the recorded dynamic args of the last computation are part of the invocation
+    // if they are unknown, we have to compute
+    auto full_invoc = invoc;
+    auto has_full_invoc = true;
+    if (has_dynamic_args && !is_volatile)
     {
-        res_desc rdesc;
-        rdesc.comp = desc.computation;
-        rdesc.args.push_back_range(desc.args);
-        rdesc.is_volatile = desc.is_volatile;
-        rdesc.is_persisted = desc.is_persisted;
-        rdesc.ref_counter = cc::alloc<ref_count>();
-        rdesc.deserialize = desc.deserialize;
-        counter = rdesc.ref_counter;
+        auto dynamic_args = m->dynamic_args_store.get(invoc, [](cc::vector<res_hash> const& args) { return cc::vector<res_hash>(args); });
+        has_full_invoc = dynamic_args.has_value();
+        if (has_full_invoc)
+        {
+            missing_args.clear();
+            args_content_hashes.resize(dynamic_args.value().size());
+            for (auto i : cc::indices_of(dynamic_args.value()))
+            {
+                auto const arg = dynamic_args.value()[i];
+                if (auto arg_hash = this->try_get_resource_content_hash(arg, true, prio); arg_hash.has_value())
+                    args_content_hashes[i] = arg_hash.value();
+                else
+                    missing_args.push_back(arg);
+            }
+
+            if (!missing_args.empty())
+            {
+                LOG_VERBOSE("res %s waits because not all dynamic arg hashes are available", shorthash(res));
+                impl_wait_for_args(res, gen, need_content, false, prio, missing_args);
+                return true;
+            }
+
+            full_invoc = this->define_dynamic_invocation(invoc, dynamic_args.value(), args_content_hashes);
+        }
+    }
+
+    // volatile resources might change their content with each invocation
+    // so we cannot rely on the invoc_store for them
+    if (!is_volatile && has_full_invoc)
+    {
+        auto invoc_res = m->invoc_store.get(full_invoc, [&](invoc_desc const& desc) { return desc.content; });
+        if (!invoc_res.has_value())
+            invoc_res = m->find_in_invoc_layers(full_invoc);
+
+        // easy path: invoc is cached, aka we immediately have the result
+        if (invoc_res.has_value())
+        {
+            auto content_hash = invoc_res.value();
+
+            // if we also need the content, we can ask the content store
+            // if this fails, we need to actually compute the content
+            // TODO: or ask someone who knows
+            // NOTE: this is expected for evicted content
+            content_desc const* content = nullptr;
+            void const* runtime_data = nullptr;
+            if (need_content)
+            {
+                content = this->query_resident_content(content_hash);
+
+                // loading from content providers (e.g. from disk) blocks, so it's scheduled as io work
+                // NOTE: if no provider has the content, the job is enqueued again and computes it
+                if (content == nullptr && m->has_content_providers.load() && !m->is_provider_miss(content_hash))
+                {
+                    // NOTE: a load that is already in flight delivers the content
+                    if (try_claim_computation(entry, gen))
+                        impl_load_content_async(res, gen, content_hash, deserialize, prio);
+                    return true;
+                }
+
+                if (content == nullptr)
+                    LOG_VERBOSE("content %s was not found in content store (evicted or missing persistence)", shorthash(content_hash));
+                else
+                    runtime_data = content->get_runtime_data(content_hash, deserialize, m->memory_usage);
+            }
+            // NOTE: keeps the content alive until it's stored in the cache
+            auto const content_guard = detail::content_owner(content);
+
+            if (!need_content || content != nullptr)
+            {
+                LOG_VERBOSE("res %s found invoc %s (%s content %s) in cache", shorthash(res), shorthash(full_invoc), need_content ? "and" : "hash",
+                            shorthash(content_hash));
+                cc::vector<res_wait_state*> ready_waiters;
+                set_job_content(cache, gen, content_hash, content, runtime_data, ready_waiters);
+                impl_enqueue_ready_waiters(ready_waiters);
+                return true;
+            }
+        }
+    }
+
+    // 3. hard path: invoc is not cached, so we need to fetch arg content and compute it
+    //               this also include the case where invoc is cached but we need the content and it's not in the content store
 
+    // 3.1. query content for all args
+    //      (this also enqueues missing ones)
+    missing_args.clear();
+    args_content.resize(args.size());
 #if ENABLE_VERBOSE_LOG
-        cc::string deps;
-        for (auto a : desc.args)
+    cc::string dbg_s_missing_content;
+#endif
+    for (auto i : cc::indices_of(args))
+    {
+        // NOTE: outdated counts as invalid here
+        if (auto arg_content = this->try_get_resource_content(args[i], true, prio); //
+            arg_content.has_value() && !arg_content.value().is_outdated)
+            args_content[i] = arg_content.value();
+        else
         {
-            if (!deps.empty())
-                deps += ", ";
-            deps += shorthash(a);
+            missing_args.push_back(args[i]);
+#if ENABLE_VERBOSE_LOG
+            if (!dbg_s_missing_content.empty())
+                dbg_s_missing_content += ", ";
+            dbg_s_missing_content += shorthash(args[i]);
+#endif
         }
-        LOG_VERBOSE("res %s defined, deps [%s]", shorthash(hash), deps);
+    }
+
+    // not all args available? wait for them
+    if (!missing_args.empty())
+    {
+        LOG_VERBOSE("res %s waits, missing content for res: (%s)", shorthash(res), dbg_s_missing_content);
+        impl_wait_for_args(res, gen, need_content, true, prio, missing_args);
+        return true;
+    }
+
+    // 3.2 we have all args -> compute
+    //     unless another worker started the same computation in the meantime
+    if (!try_claim_computation(entry, gen))
+        return true;
+    {
+        detail::computation_job job;
+        job.res = res;
+        job.gen = gen;
+        job.invoc = invoc;
+        job.is_volatile = is_volatile;
+        job.is_persisted = is_persisted;
+        job.has_dynamic_args = has_dynamic_args;
+        job.deserialize = deserialize;
+
+        // NOTE: computations are never removed, so the desc stays valid
+        // TODO: keep comp alive once this becomes an issue
+        computation_desc const* comp_desc = nullptr;
+        auto has_comp = m->comp_store.get(comp,
+                                          [&](computation_desc const& desc)
+                                          {
+                                              comp_desc = &desc;
+                                              job.make_hash = desc.make_runtime_content_hash;
+                                          });
+        CC_ASSERT(has_comp && "overzealous GC?");
+
+        // async computation or other executor: the worker is free again immediately
+        // the job stays pending until the promise is completed (see impl_complete_async)
+        if (comp_desc->compute_resource_async || comp_desc->executor != executor_id::cpu)
+        {
+            LOG_VERBOSE("res %s compute content async ...", shorthash(res));
+
+            auto state = cc::alloc<detail::async_computation>();
+            state->system = this;
+            state->job = job;
+            state->args = cc::move(args_content);
+            args_content.clear();
+
+            m->pending_jobs.fetch_add(1);
+            impl_execute_computation(state, *comp_desc);
+            // CAUTION: state might be dead here (if completed synchronously)
+            return true;
+        }
+
+        // actual resource computation
+        // TODO: indirection
+        // TODO: split computation, ...
+        LOG_VERBOSE("res %s compute content ...", shorthash(res));
+        auto comp_result = comp_desc->compute_resource(args_content);
+
+        // the args are no longer needed, so don't keep them alive
+        args_content.clear();
+
+        impl_finish_computation(job, cc::move(comp_result));
+    }
+
+    return true;
+}
+
+
+void res::base::ResourceSystem::impl_execute_computation(detail::async_computation* state, computation_desc const& comp)
+{
+    auto run = [this, state, &comp]
+    {
+        // the task might have been queued for a while
+        if (comp.executor != executor_id::cpu && (m->is_shutting_down.load() || !impl_is_needed(state->job.res)))
+        {
+            impl_cancel_async(state);
+            return;
+        }
+
+        if (comp.compute_resource_async)
+            comp.compute_resource_async(state->args, computation_promise(state));
+        else
+            computation_promise(state).complete(comp.compute_resource(state->args));
+    };
+
+    switch (comp.executor)
+    {
+    case executor_id::cpu:
+        run();
+        return;
+
+    case executor_id::main_thread:
+    {
+        {
+            auto lock = std::lock_guard{m->main_thread_jobs_mutex};
+            m->main_thread_jobs.push_back(run);
+            m->queued_main_thread_jobs.fetch_add(1);
+        }
+
+        // process_until_idle might wait for this job
+        {
+            auto lock = std::lock_guard{m->workers_mutex};
+        }
+        m->idle_cv.notify_all();
+        return;
+    }
+
+    default:
+    {
+        auto const idx = int(comp.executor);
+        CC_ASSERT(0 <= idx && idx < max_executor_count && "invalid executor id");
+
+        auto lock = std::shared_lock{m->executors_mutex};
+        if (auto exec = m->executors[idx].get())
+        {
+            exec->execute(run);
+            return;
+        }
+    }
+    }
+
+    // no executor set: execute on this worker
+    run();
+}
+
+void res::base::ResourceSystem::impl_load_content_async(res_hash res, int gen, content_hash hash, deserialize_fun_ptr deserialize, priority prio)
+{
+    // NOTE: counts as pending job until the content is stored (or the job is enqueued again)
+    m->pending_jobs.fetch_add(1);
+
+    auto load = [this, res, gen, hash, deserialize, prio]
+    {
+        // the task might have been queued for a while
+        if (!impl_is_needed(res))
+        {
+            impl_cancel_job(res);
+            impl_finish_job();
+            return;
+        }
+
+        auto const entry = m->lookup_res(res);
+        CC_ASSERT(entry.cache != nullptr && "overzealous GC?");
+
+        auto const content = this->query_content(hash);
+        if (content == nullptr)
+        {
+            // no provider has it, so it's computed instead
+            LOG_VERBOSE("content %s was not found by any content provider", shorthash(hash));
+            m->add_provider_miss(hash);
+            release_computation(entry, gen);
+            impl_enqueue_res(res, true, prio);
+            impl_finish_job();
+            return;
+        }
+
+        // NOTE: the deserialization also happens here, i.e. never on the thread that requested the resource
+        auto const runtime_data = content->get_runtime_data(hash, deserialize, m->memory_usage);
+        auto const content_guard = detail::content_owner(content);
+
+        cc::vector<res_wait_state*> ready_waiters;
+        set_job_content(*entry.cache, gen, hash, content, runtime_data, ready_waiters);
+        release_computation(entry, gen);
+        impl_enqueue_ready_waiters(ready_waiters);
+        impl_finish_job();
+    };
+
+    {
+        auto lock = std::shared_lock{m->executors_mutex};
+        if (auto exec = m->executors[int(executor_id::io)].get())
+        {
+            exec->execute(cc::move(load));
+            return;
+        }
+    }
+
+    // no io executor: load on this worker
+    load();
+}
+
+void res::base::ResourceSystem::impl_finish_computation(detail::computation_job const& job,
+                                                        computation_result comp_result,
+                                                        cc::span<cc::pair<res_hash, content_hash> const> dynamic_args)
+{
+    CC_ASSERT((job.has_dynamic_args || dynamic_args.empty()) && "resource_desc::has_dynamic_args must be set for resources with dynamic args");
+
+    // resources with dynamic args: record the args and extend the invocation
+    auto invoc = job.invoc;
+    auto is_persisted = job.is_persisted;
+    if (job.has_dynamic_args)
+    {
+        cc::vector<res_hash> arg_res;
+        cc::vector<content_hash> arg_content;
+        for (auto const& [r, c] : dynamic_args)
+        {
+            arg_res.push_back(r);
+            arg_content.push_back(c);
+        }
+
+        invoc = this->define_dynamic_invocation(job.invoc, arg_res, arg_content);
+        is_persisted = false; // the recorded args are not persisted, so the invoc could never be found again
+
+        // dirtiness must also be propagated along dynamic args
+        {
+            auto lock = std::lock_guard(m->dependents_mutex);
+            auto const entry = m->lookup_res(job.res);
+            for (auto const& r : arg_res)
+                if (auto const arg = m->lookup_res(r); arg.desc != nullptr && arg.desc->depends_on_volatile)
+                {
+                    auto is_known = false;
+                    for (auto const& d : arg.desc->dependents)
+                        is_known = is_known || d.desc == entry.desc;
+                    if (!is_known)
+                        arg.desc->dependents.push_back(entry);
+                }
+        }
+
+        m->dynamic_args_store.set(job.invoc, cc::move(arg_res));
+    }
+
+    auto content_hash = make_content_hash(comp_result, invoc, job.make_hash, job.is_volatile, m->tree_hash_pool);
+
+#if ENABLE_VERBOSE_LOG
+    if (comp_result.serialized_data.has_value())
+    {
+        auto data = comp_result.serialized_data.value().bytes();
+        auto ext = "";
+        if (data.size() > 16)
+        {
+            data = data.subspan(0, 16);
+            ext = " ...";
+        }
+        LOG_VERBOSE("content %s is serialized %s%s", shorthash(content_hash), data, ext);
+    }
 #endif
 
-        m->res_store.set(hash, cc::move(rdesc));
-    }
+    // store result in content store and get runtime data
+    // CAUTION: this must only be set if the content is new
+    //          otherwise we're invalidating previously valid references to the data
+    auto const content = this->set_and_get_content_if_new(content_hash, cc::move(comp_result));
+    auto const content_guard = detail::content_owner(content);
+    // CAUTION: comp_result is dead here
+    auto const runtime_data = content->get_runtime_data(content_hash, job.deserialize, m->memory_usage);
+
+    // store result in invoc store
+    // we always set this
+    // due to environment non-determinism, this might not be the same hash as before
+    // NOTE: theoretically, the same invoc hash could be reached via a persisted and non-persisted resource
+    //       this can only happen if "is_persisted" is set per resource and not per comp
+    //       in that case, we might want to do a at-least-one policy here
+    m->invoc_store.set(invoc, invoc_desc{content_hash, is_persisted});
+    if (is_persisted && m->is_recording_persistent_invocs.load())
+    {
+        auto lock = std::lock_guard{m->new_persistent_invocs_mutex};
+        m->new_persistent_invocs.emplace_back(invoc, content_hash);
+    }
+
+    // store result in res cache
+    auto const entry = m->lookup_res(job.res);
+    CC_ASSERT(entry.cache != nullptr && "overzealous GC?");
+    auto& cache = *entry.cache;
+    cc::vector<res_wait_state*> ready_waiters;
+    {
+        auto lock = std::lock_guard{cache.lock};
+        if (cache.content_gen <= job.gen) // otherwise a newer job finished in the meantime
+            cache.set_content(job.gen, content_hash, content, runtime_data);
+        if (entry.desc->computing_gen == job.gen)
+            entry.desc->computing_gen = -1; // see release_computation
+        collect_ready_waiters(cache, ready_waiters);
+    }
+    impl_enqueue_ready_waiters(ready_waiters);
+    LOG_VERBOSE("res %s has fully defined content %s", shorthash(job.res), shorthash(content_hash));
+}
+
+void res::base::ResourceSystem::impl_complete_async(detail::async_computation* state, computation_result comp_result)
+{
+    auto const job = state->job;
+    auto const dynamic_args = cc::move(state->dynamic_args);
+
+    // args are released before storing the result
+    cc::free(state);
+
+    impl_finish_computation(job, cc::move(comp_result), dynamic_args);
+    impl_finish_job();
+}
+
+void res::base::ResourceSystem::impl_cancel_async(detail::async_computation* state)
+{
+    auto const res = state->job.res;
+    cc::free(state);
+
+    impl_cancel_job(res);
+    impl_finish_job();
+}
+
+bool res::base::ResourceSystem::impl_is_needed(res_hash res)
+{
+    auto const entry = m->lookup_res(res);
+    CC_ASSERT(entry.desc != nullptr);
+    return m->is_needed(entry);
+}
+
+void res::base::ResourceSystem::impl_cancel_job(res_hash res)
+{
+    auto const entry = m->lookup_res(res);
+    CC_ASSERT(entry.cache != nullptr);
+
+    // waiters would otherwise wait forever
+    // they are woken up and then usually cancelled as well (they are not needed either, otherwise this would be needed)
+    // NOTE: waiters that wait for other args as well are only woken up once those are ready
+    cc::vector<res_wait_state*> ready_waiters;
+    {
+        auto& cache = *entry.cache;
+        auto lock = std::lock_guard{cache.lock};
+
+        // allows enqueuing (and computing) the resource again
+        cache.enqueued_for_name_gen = -1;
+        cache.enqueued_for_content_gen = -1;
+        entry.desc->computing_gen = -1;
+
+        if (cache.waiters != nullptr)
+        {
+            for (auto w : *cache.waiters)
+                if (w->missing_args.fetch_sub(1) == 1)
+                    ready_waiters.push_back(w);
+            cache.waiters->clear();
+        }
+    }
+    impl_enqueue_ready_waiters(ready_waiters);
+}
+
+bool res::base::computation_promise::is_cancelled() const
+{
+    CC_ASSERT(_state != nullptr && "promise is already completed (or moved-from)");
+    return !_state->system->impl_is_needed(_state->job.res);
+}
+
+void res::base::computation_promise::cancel()
+{
+    CC_ASSERT(_state != nullptr && "promise is already completed (or moved-from)");
+    auto const state = _state;
+    _state = nullptr;
+    state->system->impl_cancel_async(state);
+}
 
-    CC_ASSERT(counter != nullptr);
-    return {hash, counter};
+void res::base::computation_promise::add_dynamic_arg(res_hash res, content_hash content)
+{
+    CC_ASSERT(_state != nullptr && "promise is already completed (or moved-from)");
+    CC_ASSERT(_state->job.has_dynamic_args && "resource_desc::has_dynamic_args must be set for resources with dynamic args");
+    _state->dynamic_args.emplace_back(res, content);
 }
 
-cc::optional<res::base::content_ref> res::base::ResourceSystem::try_get_resource_content(res_hash res, bool enqueue_if_not_found)
+void res::base::computation_promise::complete(computation_result result)
 {
-    cc::optional<content_ref> result;
-    auto need_compute = false;
-    int const target_generation = generation;
+    CC_ASSERT(_state != nullptr && "promise is already completed (or moved-from)");
+    auto const state = _state;
+    _state = nullptr;
+    state->system->impl_complete_async(state, cc::move(result));
+}
 
-    // 1. read-only res db lookup
-    //    this is the fast path
-    auto has_resource = m->res_store.get(res,
-                                         [&](res_desc const& desc)
-                                         {
-                                             // see if cached version found
-                                             // NOTE: nullopt content_data means only content_hash, not actual data is known
-                                             if (desc.content_gen == target_generation && desc.content_data.has_value())
-                                             {
-                                                 // we guarantee that this is the stored data
-                                                 CC_ASSERT(desc.content_data.has_value());
-                                                 result = desc.content_data;
-                                                 return;
-                                             }
-                                             else
-                                             {
-                                                 // cached content is either :
-                                                 // - outdated
-                                                 // - computed but not cached
-                                                 // - not computed
-                                                 if (desc.enqueued_for_content_gen != target_generation)
-                                                     need_compute = true;
-                                             }
-
-                                             // try to return outdated data
-                                             if (desc.content_data.has_value())
-                                             {
-                                                 auto content = desc.content_data.value();
-                                                 LOG_VERBOSE("returning outdated content for %s", shorthash(res));
-                                                 content.is_outdated = true;
-                                                 result = content;
-                                             }
-                                         });
-
-    if (!has_resource)
+res::base::computation_promise& res::base::computation_promise::operator=(computation_promise&& rhs) noexcept
+{
+    if (this != &rhs)
     {
-        LOG_ERROR("no resource known with id %s", shorthash(res));
-        return result;
+        if (_state != nullptr)
+            complete_with_abandoned_error();
+        _state = rhs._state;
+        rhs._state = nullptr;
     }
+    return *this;
+}
+
+res::base::computation_promise::~computation_promise()
+{
+    if (_state != nullptr)
+        complete_with_abandoned_error();
+}
 
-    // 2. if no cached data found, trigger computation
-    if (need_compute && enqueue_if_not_found)
+void res::base::computation_promise::complete_with_abandoned_error()
+{
+    // abandoning is fine for cancelled computations
+    if (is_cancelled())
     {
-        // set to enqueued in res db
-        auto need_enqueue = false;
-        auto ok = m->res_store.modify(res,
-                                      [&](res_desc& desc)
-                                      {
-                                          if (desc.enqueued_for_content_gen == target_generation)
-                                              return; // already enqueued
-
-                                          need_enqueue = true;
-                                          desc.enqueued_for_content_gen = target_generation;
-                                      });
-        CC_ASSERT(ok && "overzealous GC?");
-
-        // actually enqueue
-        if (need_enqueue)
-        {
-            LOG_VERBOSE("res %s enqueued for content", shorthash(res));
-            auto lock = std::lock_guard{m->queue_compute_content_of_resource_mutex};
-            m->queue_compute_content_of_resource.push_back(res);
-        }
+        cancel();
+        return;
     }
 
-    if (!result.has_value())
-        LOG_VERBOSE("no content available for res %s", shorthash(res));
+    LOG_WARN("async computation of res %s was abandoned without a result", shorthash(_state->job.res));
 
-    // NOTE: result can be outdated
-    return result;
+    computation_result res;
+    content_error_data err;
+    err.message = "async computation was abandoned without a result";
+    res.error_data = cc::move(err);
+    complete(cc::move(res));
 }
 
-cc::optional<res::base::content_hash> res::base::ResourceSystem::try_get_resource_content_hash(res_hash res, bool enqueue_if_not_found)
+void res::base::ResourceSystem::invalidate_volatile_resources()
 {
-    cc::optional<content_hash> result;
-    auto need_compute = false;
-    int const target_generation = generation;
+    auto lock = std::lock_guard(m->dependents_mutex);
+
+    // NOTE: all resources are marked before the new generation is published
+    //       so that nobody observes the new generation with stale valid content
+    [[maybe_unused]] auto const affected = mark_dirty(m->volatile_resources, generation + 1);
+    cc::intrin_atomic_add(&generation, 1);
+
+    LOG_VERBOSE("invalidated %s resources (%s volatile)", affected, m->volatile_resources.size());
+}
 
-    // 1. read-only res db lookup
-    //    this is the fast path
-    auto has_resource = m->res_store.get(res,
-                                         [&](res_desc const& desc)
-                                         {
-                                             // see if cached version found
-                                             if (desc.content_gen == target_generation)
-                                                 result = desc.content_name;
-                                             // otherwise check if already enqueued
-                                             else if (desc.enqueued_for_content_gen != target_generation && //
-                                                      desc.enqueued_for_name_gen != target_generation)
-                                                 need_compute = true;
-                                         });
-
-    if (!has_resource)
+void res::base::ResourceSystem::invalidate_volatile_resource(res_hash res)
+{
+    auto const entry = m->lookup_res(res);
+    if (entry.desc == nullptr)
     {
         LOG_ERROR("no resource known with id %s", shorthash(res));
-        return result;
+        return;
     }
+    CC_ASSERT(entry.desc->is_volatile && "only volatile resources can be invalidated");
+
+    auto lock = std::lock_guard(m->dependents_mutex);
+
+    [[maybe_unused]] auto const affected = mark_dirty(cc::span<res_entry const>(&entry, 1), generation + 1);
+    cc::intrin_atomic_add(&generation, 1);
+
+    LOG_VERBOSE("invalidated %s resources (from %s)", affected, shorthash(res));
+}
+
+void res::base::ResourceSystem::impl_enqueue_res(res_hash res, bool need_content, priority prio)
+{
+    // NOTE: pending before queued so that idle is never signaled while a job is in a queue
+    m->pending_jobs.fetch_add(1);
+
+    auto& queues = m->queues[int(prio)];
+    auto& queue = need_content ? queues.content : queues.content_hash;
+    queue.push(res);
+    m->queued_jobs.fetch_add(1);
+
+    impl_wake_worker();
+}
 
-    // 2. if no cached data found, trigger computation
-    if (need_compute && enqueue_if_not_found)
+void res::base::ResourceSystem::impl_enqueue_res_many(cc::span<res_hash const> res, bool need_content, priority prio)
+{
+    // NOTE: pending before queued so that idle is never signaled while a job is in a queue
+    m->pending_jobs.fetch_add(int(res.size()));
+
+    auto& queues = m->queues[int(prio)];
+    auto& queue = need_content ? queues.content : queues.content_hash;
+    for (auto r : res)
+        queue.push(r);
+    m->queued_jobs.fetch_add(int(res.size()));
+
+    // wake up as many workers as useful
+    if (res.size() == 1)
+        impl_wake_worker();
+    else
     {
-        // set to enqueued in res db
-        auto need_enqueue = false;
-        auto ok = m->res_store.modify(res,
-                                      [&](res_desc& desc)
-                                      {
-                                          // NOTE: enqueued for content will also set name
-                                          if (desc.enqueued_for_name_gen == target_generation || //
-                                              desc.enqueued_for_content_gen == target_generation)
-                                              return; // already enqueued
-
-                                          need_enqueue = true;
-                                          desc.enqueued_for_name_gen = target_generation;
-                                      });
-        CC_ASSERT(ok && "overzealous GC?");
-
-        // actually enqueue
-        if (need_enqueue)
+        if (m->sleeping_workers.load() > 0)
         {
-            LOG_VERBOSE("res %s enqueued for hash", shorthash(res));
-            auto lock = std::lock_guard{m->queue_compute_content_hash_of_resource_mutex};
-            m->queue_compute_content_hash_of_resource.push_back(res);
+            {
+                auto lock = std::lock_guard{m->workers_mutex};
+            }
+            m->workers_cv.notify_all();
         }
+        m->wake_idle_waiters();
     }
-
-    // NOTE: result can be outdated
-    return result;
 }
 
-res::base::content_ref res::base::ResourceSystem::set_and_get_content_if_new(content_hash hash, int gen, deserialize_fun_ptr deserializer, computation_result comp_result)
+void res::base::ResourceSystem::impl_wake_worker()
 {
-    // for the combined semantics, we use modify_many here
-    content_ref content_data;
-    m->content_store.modify_many(
-        [&](cc::map<base::content_hash, content_desc>& data)
+    // wake up one worker
+    // NOTE: queued_jobs and sleeping_workers are seq_cst
+    //       so either the worker sees the new job or we see the sleeping worker
+    //       locking is then required to prevent lost wakeups between predicate check and wait
+    if (m->sleeping_workers.load() > 0)
+    {
         {
-            content_desc& desc = data.get_or_create(hash, [&] { return cc::move(comp_result); });
-            content_data = desc.make_ref(gen, hash, deserializer);
-        });
-    return content_data;
+            auto lock = std::lock_guard{m->workers_mutex};
+        }
+        m->workers_cv.notify_one();
+    }
+    m->wake_idle_waiters();
 }
 
-bool res::base::ResourceSystem::impl_process_queue_res(bool need_content)
+void res::base::ResourceSystem::impl_wait_for_args(res_hash res, int gen, bool need_content, bool wait_for_content, priority prio, cc::span<res_hash const> missing_args)
 {
-    res_hash res;
+    auto state = cc::alloc<res_wait_state>();
+    state->res = res;
+    state->gen = gen;
+    state->need_content = need_content;
+    state->wait_for_content = wait_for_content;
+    state->prio = prio;
+    impl_register_waiter(state, missing_args);
+}
 
-    // local caches
-    static thread_local cc::vector<res_hash> args;
-    static thread_local cc::vector<content_hash> args_content_hashes;
-    static thread_local cc::vector<content_ref> args_content;
+void res::base::ResourceSystem::impl_register_waiter(detail::res_wait_state* state, cc::span<res_hash const> missing_args)
+{
+    CC_ASSERT(!missing_args.empty());
+    auto const gen = state->gen;
+    auto const wait_for_content = state->wait_for_content;
+    auto const prio = state->prio;
 
-    auto& queue = need_content ? m->queue_compute_content_of_resource : m->queue_compute_content_hash_of_resource;
-    auto& queue_mutex = need_content ? m->queue_compute_content_of_resource_mutex : m->queue_compute_content_hash_of_resource_mutex;
+    // +1 guard so that the job cannot be enqueued while still registering
+    state->missing_args = int(missing_args.size()) + 1;
 
-    // get job
+    auto ready_args = 1; // guard
+    for (auto const& arg : missing_args)
     {
-        auto lock = std::lock_guard{queue_mutex};
-        if (queue.empty())
-            return false;
+        auto const entry = m->lookup_res(arg);
+        CC_ASSERT(entry.cache != nullptr && "overzealous GC?");
 
-        res = queue.pop_front();
-    }
-
-    // process
-    //   we have a resource "res"
-    //   and want to know the content hash for it
-    // LOG("res %s processing...", shorthash(res));
+        auto is_registered = false;
+        auto need_enqueue = false;
+        {
+            auto& cache = *entry.cache;
+            auto lock = std::lock_guard{cache.lock};
+            if (!is_ready_for(cache, gen, wait_for_content)) // otherwise finished in the meantime
+            {
+                if (cache.waiters == nullptr)
+                    cache.waiters = cc::make_unique<cc::vector<res_wait_state*>>();
+                cache.waiters->push_back(state);
+                is_registered = true;
+
+                // the job of the arg might have been cancelled before we registered (see impl_cancel_job)
+                // so it is requested again
+                // NOTE: this is also where the priority of the waiting job propagates to its args
+                if (!cache.is_enqueued_for(cache.enqueued_for_content_gen, gen)
+                    && (wait_for_content || !cache.is_enqueued_for(cache.enqueued_for_name_gen, gen)))
+                {
+                    (wait_for_content ? cache.enqueued_for_content_gen : cache.enqueued_for_name_gen) = gen;
+                    cache.enqueued_priority = prio;
+                    need_enqueue = true;
+                }
+                else if (prio > cache.enqueued_priority)
+                {
+                    cache.enqueued_priority = prio;
+                    need_enqueue = true;
+                }
+            }
+        }
 
-    // 1. get comp + arg res_hashes
-    //   (can check if resource already up to date)
-    int const gen = generation;
-    auto is_up_to_date = false;
-    auto is_volatile = false;
-    auto is_persisted = false;
-    deserialize_fun_ptr deserialize = nullptr;
-    comp_hash comp;
-    auto found_res = m->res_store.get(res,
-                                      [&](res_desc const& desc)
-                                      {
-                                          if (desc.content_gen == gen && (!need_content || desc.content_data.has_value()))
-                                          {
-                                              is_up_to_date = true;
-                                              return;
-                                          }
-
-                                          comp = desc.comp;
-                                          args = desc.args; // copy
-                                          is_volatile = desc.is_volatile;
-                                          is_persisted = desc.is_persisted;
-                                          deserialize = desc.deserialize;
-                                      });
-    CC_ASSERT(found_res && "overzealous GC?");
-
-    // early out: someone already updated the content
-    if (is_up_to_date)
-        return true;
+        if (need_enqueue)
+            impl_enqueue_res(arg, wait_for_content, prio);
 
-    // 2. query content hashes for all args
-    auto has_all_arg_hashes = true;
-    args_content_hashes.resize(args.size());
-    for (auto i : cc::indices_of(args))
-    {
-        if (auto arg_hash = this->try_get_resource_content_hash(args[i]); arg_hash.has_value())
-            args_content_hashes[i] = arg_hash.value();
-        else
-            has_all_arg_hashes = false;
+        if (!is_registered)
+            ++ready_args;
     }
 
-    // not all args available? requeue
-    if (!has_all_arg_hashes)
+    // all args became ready while registering
+    if (state->missing_args.fetch_sub(ready_args) == ready_args)
     {
-        LOG_VERBOSE("res %s requeue because not all arg hashes are available", shorthash(res));
-        auto lock = std::lock_guard{queue_mutex};
-        queue.push_back(res);
-        return true;
+        cc::vector<res_wait_state*> ready_waiters;
+        ready_waiters.push_back(state);
+        impl_enqueue_ready_waiters(ready_waiters);
     }
+}
 
-    // read cached invocation data
-    auto const invoc = this->define_invocation(comp, args_content_hashes);
-
-    // volatile resources might change their content with each invocation
-    // so we cannot rely on the invoc_store for them
-    if (!is_volatile)
+void res::base::ResourceSystem::impl_enqueue_ready_waiters(cc::span<detail::res_wait_state* const> waiters)
+{
+    for (auto w : waiters)
     {
-        auto invoc_res = m->invoc_store.get(invoc, [&](invoc_desc const& desc) { return desc.content; });
+        LOG_VERBOSE("res %s woken up", shorthash(w->res));
 
-        // easy path: invoc is cached, aka we immediately have the result
-        if (invoc_res.has_value())
+        // callbacks are executed as separate jobs
+        // NOTE: the waiter is freed after the callback was executed
+        if (w->callback)
         {
-            auto content_hash = invoc_res.value();
-
-            // if we also need the content, we can ask the content store
-            // if this fails, we need to actually compute the content
-            // TODO: or ask someone who knows
-            cc::optional<content_ref> content_data;
-            if (need_content)
-            {
-                content_data = this->query_content(content_hash, deserialize);
-                if (!content_data.has_value())
-                    LOG_WARN("content %s was not found in content store. missing persistence?", shorthash(content_hash));
-            }
-
-            if (!need_content || content_data.has_value())
-            {
-                LOG_VERBOSE("res %s found invoc %s (%s content %s) in cache", shorthash(res), shorthash(invoc), need_content ? "and" : "hash",
-                            shorthash(content_hash));
-                auto ok = m->res_store.modify(res,
-                                              [&](res_desc& desc)
-                                              {
-                                                  if (desc.content_gen == gen && desc.content_data.has_value())
-                                                      return; // already up to date with content
-
-                                                  desc.content_gen = gen;
-                                                  desc.content_name = content_hash;
-                                                  desc.content_data = content_data;
-                                              });
-                CC_ASSERT(ok && "overzealous GC?");
-                return true;
-            }
+            m->pending_jobs.fetch_add(1);
+            m->queue_callbacks.push(w);
+            m->queued_jobs.fetch_add(1);
+            impl_wake_worker();
+            continue;
         }
+
+        impl_enqueue_res(w->res, w->need_content, w->prio);
+        cc::free(w);
     }
+}
 
-    // 3. hard path: invoc is not cached, so we need to fetch arg content and compute it
-    //               this also include the case where invoc is cached but we need the content and it's not in the content store
+void res::base::ResourceSystem::notify_when_content_available(res_hash res, cc::unique_function<void()> callback, priority prio)
+{
+    auto state = cc::alloc<res_wait_state>();
+    state->res = res;
+    state->gen = generation;
+    state->need_content = true;
+    state->wait_for_content = true;
+    state->prio = prio;
+    state->callback = cc::move(callback);
+
+    // trigger computation (if required)
+    this->try_get_resource_content(res, true, prio);
+
+    impl_register_waiter(state, cc::span<res_hash const>(&res, 1));
+}
 
-    // 3.1. query content for all args
-    auto has_all_arg_content = true;
-    args_content.resize(args.size());
-#if ENABLE_VERBOSE_LOG
-    cc::string dbg_s_missing_content;
-#endif
-    for (auto i : cc::indices_of(args))
+void res::base::ResourceSystem::impl_finish_job()
+{
+    if (m->pending_jobs.fetch_sub(1) == 1)
     {
-        // NOTE: outdated counts as invalid here
-        if (auto arg_content = this->try_get_resource_content(args[i]); //
-            arg_content.has_value() && !arg_content.value().is_outdated)
-            args_content[i] = arg_content.value();
-        else
+        // system is idle
         {
-            has_all_arg_content = false;
-#if ENABLE_VERBOSE_LOG
-            if (!dbg_s_missing_content.empty())
-                dbg_s_missing_content += ", ";
-            dbg_s_missing_content += shorthash(args[i]);
-#endif
+            auto lock = std::lock_guard{m->workers_mutex};
         }
+        m->idle_cv.notify_all();
     }
+}
 
-    // not all args available? requeue
-    if (!has_all_arg_content)
+bool res::base::ResourceSystem::impl_process_any_job()
+{
+    // callbacks first, they usually continue computations that are already in flight
+    if (res_wait_state* w; m->queue_callbacks.try_pop(w))
     {
-        LOG_VERBOSE("res %s requeue, missing content for res: (%s)", shorthash(res), dbg_s_missing_content);
-        auto lock = std::lock_guard{queue_mutex};
-        queue.push_back(res);
+        m->queued_jobs.fetch_sub(1);
+        w->callback();
+        cc::free(w);
+        impl_finish_job();
         return true;
     }
 
-    // 3.2 we have all args -> compute
+    // within a level: compute content hashes first where required
+    // then compute actual contents
+    auto const process_level = [&](int p)
     {
-        // TODO: keep comp alive once this becomes an issue
-        cc::function_ref<computation_result(cc::span<content_ref const>)> compute_resource;
-        cc::function_ptr<content_hash(void const*)> make_hash;
-        auto has_comp = m->comp_store.get(comp,
-                                          [&](computation_desc const& desc)
-                                          {
-                                              compute_resource = desc.compute_resource;
-                                              make_hash = desc.make_runtime_content_hash;
-                                          });
-        CC_ASSERT(has_comp && "overzealous GC?");
+        for (auto need_content : {false, true})
+            if (impl_process_queue_res(need_content, priority(p)))
+            {
+                // aging: all waiting lower levels were skipped once more
+                m->queues[p].skipped.store(0);
+                for (auto lower = 0; lower < p; ++lower)
+                    if (!m->queues[lower].empty_approx())
+                        m->queues[lower].skipped.fetch_add(1);
 
-        // actual resource computation
-        // TODO: indirection
-        // TODO: split computation, ...
-        LOG_VERBOSE("res %s compute content ...", shorthash(res));
-        auto comp_result = compute_resource(args_content);
+                impl_finish_job();
+                return true;
+            }
+        return false;
+    };
 
-        auto content_hash = make_content_hash(comp_result, invoc, make_hash, is_volatile);
+    // starving levels first (lowest first)
+    for (auto p = 0; p < priority_count - 1; ++p)
+        if (m->queues[p].skipped.load() >= impl::starvation_limit && process_level(p))
+            return true;
 
-#if ENABLE_VERBOSE_LOG
-        if (comp_result.serialized_data.has_value())
-        {
-            auto data = cc::span(comp_result.serialized_data.value().blob);
-            auto ext = "";
-            if (data.size() > 16)
-            {
-                data = data.subspan(0, 16);
-                ext = " ...";
-            }
-            LOG_VERBOSE("content %s is serialized %s%s", shorthash(content_hash), data, ext);
-        }
-#endif
+    // then strictly by priority
+    for (auto p = priority_count - 1; p >= 0; --p)
+        if (process_level(p))
+            return true;
 
-        // store result in content store and make content ref
-        // CAUTION: this must only be set if the content is new
-        //          otherwise we're invalidating previously valid references to the data
-        auto content_data = this->set_and_get_content_if_new(content_hash, gen, deserialize, cc::move(comp_result));
-        // CAUTION: comp_result is dead here
-
-        // store result in invoc store
-        // we always set this
-        // due to environment non-determinism, this might not be the same hash as before
-        // NOTE: theoretically, the same invoc hash could be reached via a persisted and non-persisted resource
-        //       this can only happen if "is_persisted" is set per resource and not per comp
-        //       in that case, we might want to do a at-least-one policy here
-        m->invoc_store.set(invoc, invoc_desc{content_hash, is_persisted});
-
-        // store result in res store
-        auto res_ok = m->res_store.modify(res,
-                                          [&](res_desc& desc)
-                                          {
-                                              desc.content_gen = gen;
-                                              desc.content_name = content_hash;
-                                              desc.content_data = content_data;
-                                          });
-        CC_ASSERT(res_ok && "overzealous GC?");
-        LOG_VERBOSE("res %s has fully defined content %s", shorthash(res), shorthash(content_hash));
-    }
+    return false;
+}
 
-    return true;
+void res::base::ResourceSystem::impl_worker_main()
+{
+    while (true)
+    {
+        if (impl_process_any_job())
+            continue;
+
+        auto lock = std::unique_lock{m->workers_mutex};
+        m->sleeping_workers.fetch_add(1);
+        m->workers_cv.wait(lock, [&] { return m->workers_should_stop || m->queued_jobs.load() > 0; });
+        m->sleeping_workers.fetch_sub(1);
+        if (m->workers_should_stop)
+            return;
+    }
 }
 
+void res::base::ResourceSystem::start_workers(int num_threads)
+{
+    if (num_threads < 0)
+        num_threads = cc::max(1, int(std::thread::hardware_concurrency()));
 
-void res::base::ResourceSystem::invalidate_volatile_resources()
+    auto lock = std::lock_guard{m->workers_mutex};
+    m->workers_should_stop = false;
+    for (auto i = 0; i < num_threads; ++i)
+        m->workers.emplace_back([this] { impl_worker_main(); });
+}
+
+void res::base::ResourceSystem::stop_workers()
 {
-    // simple for now
-    cc::intrin_atomic_add(&generation, 1);
+    cc::vector<std::thread> workers;
+
+    {
+        auto lock = std::lock_guard{m->workers_mutex};
+        m->workers_should_stop = true;
+        workers = cc::move(m->workers);
+    }
+    m->workers_cv.notify_all();
+
+    for (auto& t : workers)
+        t.join();
 }
 
-void res::base::ResourceSystem::process_all()
+int res::base::ResourceSystem::get_worker_count() const
 {
-    // DEBUG
-    auto max_tries = 1000;
+    auto lock = std::lock_guard{m->workers_mutex};
+    return int(m->workers.size());
+}
 
-    // not locked because this is fine to be approximative
-    while (!m->queue_compute_content_of_resource.empty() || !m->queue_compute_content_hash_of_resource.empty())
+void res::base::ResourceSystem::process_until_idle()
+{
+    // help processing
+    // NOTE: the calling thread is considered the main thread
+    while (impl_process_any_job() || process_main_thread_jobs() > 0)
     {
-        // compute content hashes first where required
-        if (!m->queue_compute_content_hash_of_resource.empty())
-            impl_process_queue_res(false);
+    }
 
-        // then compute actual contents
-        if (!m->queue_compute_content_of_resource.empty())
-            impl_process_queue_res(true);
+    // wait for in-flight jobs of the workers and other executors
+    // NOTE: those might enqueue new jobs that we also help with
+    while (m->pending_jobs.load() > 0)
+    {
+        {
+            auto lock = std::unique_lock{m->workers_mutex};
+            m->idle_waiters.fetch_add(1);
+            m->idle_cv.wait(lock, [&]
+                            { return m->pending_jobs.load() == 0 || m->queued_jobs.load() > 0 || m->queued_main_thread_jobs.load() > 0; });
+            m->idle_waiters.fetch_sub(1);
+        }
 
-        if (max_tries-- < 0)
+        while (impl_process_any_job() || process_main_thread_jobs() > 0)
         {
-            LOG_WARN("max tries in process_all reached");
-            break;
         }
     }
 }
 
+void res::base::ResourceSystem::process_all() { process_until_idle(); }
+
+int res::base::ResourceSystem::process_main_thread_jobs()
+{
+    if (m->queued_main_thread_jobs.load() == 0)
+        return 0;
+
+    cc::vector<cc::unique_function<void()>> jobs;
+    {
+        auto lock = std::lock_guard{m->main_thread_jobs_mutex};
+        jobs = cc::move(m->main_thread_jobs);
+        m->main_thread_jobs.clear();
+        m->queued_main_thread_jobs.fetch_sub(int(jobs.size()));
+    }
+
+    // NOTE: each job completes its computation (and the pending job)
+    for (auto& job : jobs)
+        job();
+
+    return int(jobs.size());
+}
+
+void res::base::ResourceSystem::set_executor(executor_id id, cc::unique_ptr<executor> exec)
+{
+    auto const idx = int(id);
+    CC_ASSERT(0 <= idx && idx < max_executor_count && "invalid executor id");
+    CC_ASSERT(id != executor_id::cpu && id != executor_id::main_thread && "built-in executor cannot be replaced");
+
+    cc::unique_ptr<executor> prev;
+    {
+        auto lock = std::lock_guard{m->executors_mutex};
+        prev = cc::move(m->executors[idx]);
+        m->executors[idx] = cc::move(exec);
+        if (id == executor_id::io)
+            m->io_pool = nullptr;
+    }
+
+    // NOTE: destroyed outside of the lock because the default io pool joins its threads
+}
+
+void res::base::ResourceSystem::set_io_thread_count(int num_threads)
+{
+    CC_ASSERT(num_threads > 0);
+
+    auto lock = std::lock_guard{m->executors_mutex};
+    if (m->io_pool != nullptr)
+        m->io_pool->set_thread_count(num_threads);
+}
+
 void res::base::ResourceSystem::inject_invoc_cache(cc::span<const cc::pair<invoc_hash, content_hash>> invocs)
 {
-    m->invoc_store.modify_many(
-        [&](cc::map<invoc_hash, invoc_desc>& data)
-        {
-            for (auto [invoc, content] : invocs)
-            {
-                auto& d = data[invoc];
-                d.content = content;
-                d.is_persisted = true;
-            }
-        });
+    using store_t = decltype(m->invoc_store);
+
+    // group by shard so that each shard is locked once
+    cc::vector<int> shard_offsets;
+    shard_offsets.resize(store_t::shard_count + 1);
+    for (auto& o : shard_offsets)
+        o = 0;
+    for (auto const& [invoc, content] : invocs)
+        shard_offsets[store_t::shard_of(invoc) + 1]++;
+    for (auto i = 0; i < store_t::shard_count; ++i)
+        shard_offsets[i + 1] += shard_offsets[i];
+
+    cc::vector<int> sorted_indices;
+    sorted_indices.resize(invocs.size());
+    {
+        auto offsets = shard_offsets;
+        for (auto i : cc::indices_of(invocs))
+            sorted_indices[offsets[store_t::shard_of(invocs[i].first)]++] = int(i);
+    }
+
+    for (auto shard = 0; shard < store_t::shard_count; ++shard)
+    {
+        if (shard_offsets[shard] == shard_offsets[shard + 1])
+            continue;
+
+        m->invoc_store.modify_shard(shard,
+                                    [&](store_t::map_t& data)
+                                    {
+                                        for (auto i = shard_offsets[shard]; i < shard_offsets[shard + 1]; ++i)
+                                        {
+                                            auto const& [invoc, content] = invocs[sorted_indices[i]];
+                                            auto& d = data[invoc];
+                                            d.content = content;
+                                            d.is_persisted = true;
+                                        }
+                                    });
+    }
 }
 
 cc::vector<cc::pair<res::base::invoc_hash, res::base::content_hash>> res::base::ResourceSystem::collect_all_persistent_invocations(cc::set<base::invoc_hash> const& known_invocs)
 {
     cc::vector<cc::pair<res::base::invoc_hash, res::base::content_hash>> res;
     m->invoc_store.read_many(
-        [&](cc::map<invoc_hash, invoc_desc> const& data)
+        [&](auto const& data)
         {
+            // NOTE: entries that are also in a layer (e.g. computed concurrently to adding it) are known as well
+            //       unless the layer has a different content (i.e. the invoc was computed again)
             for (auto&& [invoc, desc] : data)
-                if (desc.is_persisted && !known_invocs.contains(invoc))
+            {
+                if (!desc.is_persisted || known_invocs.contains(invoc))
+                    continue;
+                auto const layer_content = m->find_in_invoc_layers(invoc);
+                if (!layer_content.has_value() || layer_content.value() != desc.content)
                     res.emplace_back(invoc, desc.content);
+            }
         });
     return res;
 }
 
+cc::vector<cc::pair<res::base::invoc_hash, res::base::content_hash>> res::base::ResourceSystem::drain_new_persistent_invocations()
+{
+    cc::vector<cc::pair<invoc_hash, content_hash>> res;
+    auto lock = std::lock_guard{m->new_persistent_invocs_mutex};
+
+    // first drain: everything so far, recorded from now on
+    // NOTE: recording starts before collecting, so nothing is lost in between (but a few might be returned twice)
+    if (!m->is_recording_persistent_invocs.load())
+    {
+        m->is_recording_persistent_invocs.store(true);
+        res = collect_all_persistent_invocations();
+    }
+
+    if (res.empty())
+        res = cc::move(m->new_persistent_invocs);
+    else
+        res.push_back_range(m->new_persistent_invocs);
+    m->new_persistent_invocs.clear();
+    return res;
+}
+
+void res::base::ResourceSystem::requeue_persistent_invocations(cc::span<cc::pair<invoc_hash, content_hash> const> invocs)
+{
+    // NOTE: drained invocations exist only if recording already started
+    auto lock = std::lock_guard{m->new_persistent_invocs_mutex};
+    m->new_persistent_invocs.push_back_range(invocs);
+}
+
+void res::base::ResourceSystem::add_invoc_layer(invoc_layer const* layer)
+{
+    CC_ASSERT(layer != nullptr);
+
+    auto lock = std::unique_lock(m->invoc_layers_mutex);
+    m->invoc_layers.push_back(layer);
+    m->has_invoc_layers.store(true);
+}
+
+void res::base::ResourceSystem::remove_invoc_layer(invoc_layer const* layer)
+{
+    // NOTE: the writer lock waits for all running lookups
+    auto lock = std::unique_lock(m->invoc_layers_mutex);
+    auto& layers = m->invoc_layers;
+    size_t remaining = 0;
+    for (auto const l : layers)
+        if (l != layer)
+            layers[remaining++] = l;
+    CC_ASSERT(remaining + 1 == layers.size() && "unknown invoc layer");
+    layers.resize(remaining);
+    m->has_invoc_layers.store(!layers.empty());
+}
+
 cc::vector<res::base::content_ref> res::base::ResourceSystem::collect_all_persistent_content(cc::span<const content_hash> contents)
 {
     int curr_gen = generation;
 
     cc::vector<res::base::content_ref> res;
-    m->content_store.read_many(
-        [&](cc::map<content_hash, content_desc> const& data)
-        {
-            for (auto content : contents)
-                if (auto p_desc = data.get_ptr(content); p_desc && p_desc->has_serializable_data())
-                    res.push_back(p_desc->make_serialize_ref(curr_gen, content));
-        });
+    for (auto content : contents)
+        m->content_store.get(content,
+                             [&](content_desc const& desc)
+                             {
+                                 // NOTE: evicted content cannot be persisted
+                                 if (!desc.try_acquire())
+                                     return;
+
+                                 if (desc.has_serializable_data())
+                                     res.push_back(desc.make_serialize_ref(curr_gen, content));
+                                 else
+                                     desc.release();
+                             });
     return res;
 }
 
-void res::base::ResourceSystem::inject_content_provider(cc::unique_function<cc::optional<computation_result>(content_hash)> provider)
+res::base::content_provider_id res::base::ResourceSystem::inject_content_provider(cc::unique_function<cc::optional<computation_result>(content_hash)> provider)
 {
     auto lock = std::unique_lock(m->content_provider_mutex);
-    m->content_provider.push_back(cc::move(provider));
+    auto const id = m->next_content_provider_id++;
+    m->content_provider.push_back({id, cc::move(provider)});
+    m->has_content_providers.store(true);
+
+    // the new provider might know contents that others did not
+    auto misses_lock = std::lock_guard{m->provider_misses_mutex};
+    m->provider_misses.clear();
+    m->provider_miss_count.store(0);
+    return id;
 }
 
-cc::optional<res::base::content_ref> res::base::ResourceSystem::query_content(content_hash hash, deserialize_fun_ptr deserializer)
+void res::base::ResourceSystem::remove_content_provider(content_provider_id id)
 {
-    auto data = m->content_store.get(
-        hash, [hash, deserializer, gen = int(generation)](content_desc const& desc) { return desc.make_ref(gen, hash, deserializer); });
+    // NOTE: the writer lock waits for all running provider calls
+    auto lock = std::unique_lock(m->content_provider_mutex);
+    auto& providers = m->content_provider;
+    size_t remaining = 0;
+    for (size_t i = 0; i < providers.size(); ++i)
+        if (providers[i].id != id)
+        {
+            if (remaining != i)
+                providers[remaining] = cc::move(providers[i]);
+            ++remaining;
+        }
+    CC_ASSERT(remaining + 1 == providers.size() && "unknown content provider");
+    providers.resize(remaining);
+    m->has_content_providers.store(!providers.empty());
+}
 
-    if (!data.has_value())
-    {
-        LOG_VERBOSE("content %s has no entry in content store. trying %s fallbacks...", shorthash(hash), m->content_provider.size());
+res::base::detail::content_desc const* res::base::ResourceSystem::query_resident_content(content_hash hash)
+{
+    // NOTE: the reader lock guarantees that the content is not evicted between check and acquire
+    auto data = m->content_store.get(hash, [](content_desc const& desc) { return desc.try_acquire() ? &desc : nullptr; });
+    return data.has_value() ? data.value() : nullptr;
+}
+
+res::base::detail::content_desc const* res::base::ResourceSystem::query_content(content_hash hash)
+{
+    if (auto const content = query_resident_content(hash))
+        return content;
 
-        // TODO: should this also be "async"?
-        auto lock = std::shared_lock(m->content_provider_mutex);
-        for (auto const& provider : m->content_provider)
+    LOG_VERBOSE("content %s has no entry in content store. trying %s fallbacks...", shorthash(hash), m->content_provider.size());
+
+    // NOTE: jobs call this on the io executor (see impl_load_content_async)
+    auto lock = std::shared_lock(m->content_provider_mutex);
+    for (auto const& [id, provider] : m->content_provider)
+    {
+        auto res = provider(hash);
+        if (res.has_value())
         {
-            auto res = provider(hash);
-            if (res.has_value())
-            {
-                LOG_VERBOSE("  .. found content!");
+            LOG_VERBOSE("  .. found content!");
 
-                // store and deserialize
-                return this->set_and_get_content_if_new(hash, generation, deserializer, cc::move(res).value());
-            }
-            else
-                LOG_VERBOSE("  .. no content");
+            // store (deserialization happens lazily)
+            return this->set_and_get_content_if_new(hash, cc::move(res).value());
         }
+        else
+            LOG_VERBOSE("  .. no content");
     }
 
-    return data;
+    return nullptr;
+}
+
+res::base::invoc_hash res::base::ResourceSystem::define_dynamic_invocation(invoc_hash const& static_invoc,
+                                                                           cc::span<res_hash const> dynamic_args,
+                                                                           cc::span<content_hash const> dynamic_args_content)
+{
+    CC_ASSERT(dynamic_args.size() == dynamic_args_content.size());
+
+    // NOTE: the res hashes are included because a different set of dynamic args might have the same content
+    res::detail::hash_builder builder;
+    builder.add(cc::as_byte_span(static_invoc));
+    builder.add(cc::as_byte_span(uint32_t(dynamic_args.size())));
+    for (auto i : cc::indices_of(dynamic_args))
+    {
+        builder.add(cc::as_byte_span(dynamic_args[i]));
+        builder.add(cc::as_byte_span(dynamic_args_content[i]));
+    }
+    return res::detail::finalize_as<invoc_hash>(builder);
 }
 
 res::base::invoc_hash res::base::ResourceSystem::define_invocation(comp_hash const& computation, cc::span<content_hash const> args)
 {
-    cc::sha1_builder sha1;
-    sha1.add(cc::as_byte_span(computation));
+    res::detail::hash_builder builder;
+    builder.add(cc::as_byte_span(computation));
     for (auto const& h : args)
-        sha1.add(cc::as_byte_span(h));
-    return res::detail::finalize_as<invoc_hash>(sha1);
+        builder.add(cc::as_byte_span(h));
+    return res::detail::finalize_as<invoc_hash>(builder);
 }
@@ -16,13 +16,16 @@
 
 #include <resource-system/base/comp_result.hh>
 #include <resource-system/base/hash.hh>
+#include <resource-system/base/priority.hh>
 
 // [hash based resource system]
 // this file contains the base API to create and manage resources
 // everything not in base/ is the "porcelain" part of the resource API
 
-// [open questions]
-//  - how to handle cancellation in all this?
+// [cancellation]
+//  - resources are referenced via ref_count (e.g. by handles)
+//  - queued work of resources that are unreferenced and not needed by a referenced resource is skipped
+//  - in-flight async computations can poll computation_promise::is_cancelled
 
 // hash types:
 //
@@ -59,19 +62,124 @@
 
 // solution for "load from file" / "tweakable params" non-purity:
 // - resources can be flagged as "don't cache invocation"
-// - cached content per resource can be globally invalidated via generation int
+// - cached content per resource can be invalidated via generation int
 //   NOTE: { content hash -> content bytes } stays valid
 //         only the { res hash -> content hash } mapping is invalidated
-// - optimization: resources that transitively don't depend on volatile resource can stay valid
+// - invalidation is propagated from volatile resources along dependent edges
+//   resources that transitively don't depend on the invalidated resources stay valid
 
 namespace res::base
 {
+class ResourceSystem;
 
+namespace detail
+{
+struct res_wait_state;
+struct content_desc;
+struct computation_job;
+struct async_computation;
+}
+
+/// external references to a resource (e.g. handles)
+/// unreferenced resources are only computed if a referenced resource depends on them
+/// i.e. queued or in-flight work for them is cancelled (see computation_promise::is_cancelled)
 struct alignas(64) ref_count
 {
     int count = 1;
     void inc() { cc::intrin_atomic_add((int volatile*)&count, 1); }
     void dec() { cc::intrin_atomic_add((int volatile*)&count, -1); }
+    bool is_referenced() const { return *(int const volatile*)&count > 0; }
+};
+
+/// the executor that runs the computation of a resource (see computation_desc::executor)
+/// NOTE: only the computation itself is executed there, all bookkeeping (caches, invocations, waking up dependents) is done by the workers
+enum class executor_id : uint8_t
+{
+    // the worker pool (or threads in process_until_idle)
+    // this is the default and the right choice for pure CPU work
+    cpu,
+
+    // a separate pool of threads for blocking work like disk reads
+    // so that it overlaps with CPU work instead of stalling workers
+    io,
+
+    // only threads calling process_main_thread_jobs (or process_until_idle)
+    // for APIs that are bound to a single thread, e.g. GPU uploads
+    main_thread,
+
+    // first id of user-provided executors (see ResourceSystem::set_executor)
+    first_custom,
+};
+static constexpr int max_executor_count = 16;
+
+/// interface for user-provided executors
+/// NOTE: execute is called from arbitrary threads
+/// NOTE: each task must be executed exactly once, otherwise process_until_idle never returns
+class executor
+{
+public:
+    virtual void execute(cc::unique_function<void()> task) = 0;
+
+    virtual ~executor() = default;
+};
+
+/// immutable, externally owned lookup layer for invocations, e.g. a memory mapped persisted index
+/// the invoc store is the mutable delta on top of all layers (see ResourceSystem::add_invoc_layer)
+/// NOTE: find is called concurrently by jobs, so it must be cheap and threadsafe
+class invoc_layer
+{
+public:
+    virtual cc::optional<content_hash> find(invoc_hash invoc) const = 0;
+
+    virtual ~invoc_layer() = default;
+};
+
+/// identifies an injected content provider (see ResourceSystem::inject_content_provider)
+using content_provider_id = int;
+
+/// completion handle of an async computation (see computation_desc::compute_resource_async)
+/// must be completed exactly once, from any thread
+/// NOTE: move-only
+/// NOTE: destroying an uncompleted promise completes it with an error
+class computation_promise
+{
+public:
+    /// finishes the computation
+    /// the resource system then stores the result (content hash, content, invocation) and wakes up dependent jobs
+    void complete(computation_result result);
+
+    /// records a dependency that was discovered during the computation (in addition to resource_desc::args)
+    /// content is the content hash of res that was used
+    /// NOTE: only allowed for resources with resource_desc::has_dynamic_args
+    void add_dynamic_arg(res_hash res, content_hash content);
+
+    /// true if the result is no longer needed
+    /// i.e. the resource lost all references and no referenced resource depends on it anymore
+    /// long computations can check this regularly and then call cancel
+    /// NOTE: not free (checks the dependents if the resource itself is unreferenced)
+    bool is_cancelled() const;
+
+    /// finishes the computation without a result
+    /// the resource is computed again once it's requested again
+    void cancel();
+
+    /// true if complete was not called yet
+    bool is_pending() const { return _state != nullptr; }
+
+    computation_promise() = default;
+    computation_promise(computation_promise&& rhs) noexcept : _state(rhs._state) { rhs._state = nullptr; }
+    computation_promise& operator=(computation_promise&& rhs) noexcept;
+    computation_promise(computation_promise const&) = delete;
+    computation_promise& operator=(computation_promise const&) = delete;
+    ~computation_promise();
+
+private:
+    explicit computation_promise(detail::async_computation* state) : _state(state) {}
+    void complete_with_abandoned_error();
+
+    detail::async_computation* _state = nullptr;
+
+    friend class ResourceSystem;
 };
 
 struct computation_desc
@@ -85,18 +193,25 @@ struct computation_desc
     // NOTE: the arg content is never outdated
     cc::unique_function<computation_result(cc::span<content_ref const>)> compute_resource;
 
+    // async alternative to compute_resource, which is ignored if this is set
+    // starts the computation and returns immediately, the result is passed to the promise later (from any thread)
+    // this keeps workers free while waiting for e.g. external tools or large reads
+    // the computation counts as pending work until completed (see process_until_idle)
+    // NOTE: the args stay valid until the promise is completed
+    cc::unique_function<void(cc::span<content_ref const>, computation_promise)> compute_resource_async;
+
     // function that computes the hash of a runtime value without needing serialization
     // this is optional
     cc::function_ptr<content_hash(void const*)> make_runtime_content_hash = nullptr;
 
+    // where compute_resource (or compute_resource_async) is executed
+    // NOTE: this is not part of the comp hash, as it doesn't change the result
+    executor_id executor = executor_id::cpu;
 
-    // TODO: where can this be computed?
     // TODO: is this immediate or multipart?
-    // executor stuff
 
     // NOTE: we want the following features
-    // - computation can be done in other threads / custom queues
-    // - computation can be async + multistep
+    // - computation can be multistep
     // - computation can return a resource that should be evaluated
 };
 
@@ -118,6 +233,13 @@ struct resource_desc
     // persisted resources cause invoc cache and created content to be saved to disk
     bool is_persisted = true;
 
+    // resources with dynamic args discover additional dependencies while being computed
+    // (via computation_promise::add_dynamic_arg, so they must use compute_resource_async)
+    // the discovered args of the last computation are recorded per invocation of the static args
+    // and their content hashes become part of the invoc hash
+    // NOTE: invocations with dynamic args are not persisted (the recorded args are runtime-only)
+    bool has_dynamic_args = false;
+
     // content_ref has serialized_data and no runtime_data
     // deserialize must set either runtime_data or error_data
     // runtime_data is allowed to point into serialized_data
@@ -159,73 +281,268 @@ public:
     comp_hash define_computation(computation_desc desc);
 
     // TODO: flags for volatile resources here?
-    // NOTE: the returned counter is initialized with count=1
+    // NOTE: each call returns one reference to the resource (i.e. new counters are initialized with count=1)
+    //       which should be released (ref_count::dec) once the resource is no longer needed
+    //       unreferenced resources are only computed if a referenced resource depends on them
     cc::pair<res_hash, ref_count*> define_resource(resource_desc const& desc);
 
+    // batched version of define_resource, writes the result for descs[i] to out[i]
+    // same semantics as calling define_resource for each desc in order
+    // NOTE: meant for defining large graphs, e.g. on startup
+    //       the store is locked once per shard (instead of several times per resource)
+    //       and the definitions are allocated in contiguous blocks
+    // NOTE: args must be defined before the batch (otherwise they are not tracked for invalidation)
+    void define_resources(cc::span<resource_desc const> descs, cc::span<cc::pair<res_hash, ref_count*>> out);
+
     // NOTE: can return content with is_outdated = true
-    cc::optional<content_ref> try_get_resource_content(res_hash res, bool enqueue_if_not_found = true);
+    // NOTE: if the resource is already enqueued with a lower priority, it is enqueued again with the given one
+    cc::optional<content_ref> try_get_resource_content(res_hash res, bool enqueue_if_not_found = true, priority prio = priority::normal);
+
+    // batched version of try_get_resource_content, writes the result for res[i] to out_contents[i]
+    // returns the number of resources with (possibly outdated) content
+    // NOTE: much cheaper than individual calls for many resources
+    //       the resource lookups are grouped by store shard and all misses are enqueued at once
+    int try_get_resource_contents(cc::span<res_hash const> res,
+                                  cc::span<cc::optional<content_ref>> out_contents,
+                                  bool enqueue_if_not_found = true,
+                                  priority prio = priority::normal);
+
+    // requests the content of res and calls callback once it's available and up-to-date (or has an error)
+    // the callback is executed exactly once by a worker (or a thread in process_until_idle), never inline
+    // NOTE: the content might be outdated or evicted again by the time the callback runs
+    //       so try_get_resource_content should be checked (and this called again if necessary)
+    void notify_when_content_available(res_hash res, cc::unique_function<void()> callback, priority prio = priority::normal);
 
     // invalidates all volatile resources such as file timestamps or tweakable data
-    // this is an extremely cheap O(1) operation
+    // this marks the volatile resources and their transitive dependents as dirty
+    // and costs O(affected), i.e. resources that were already dirty or don't depend on volatile ones are not touched
     // it will cause gradual recompution of all dependent resources
     // though in practice, most will hit the content caches anyways
     void invalidate_volatile_resources();
 
+    // same as invalidate_volatile_resources but only for a single volatile resource (and its dependents)
+    void invalidate_volatile_resource(res_hash res);
+
     /// returns true if this content can be used
     /// returns false if try_get_resource_content should be called again
     /// this call is extremely cheap
     /// it's designed to be executed before every access to the content
+    /// NOTE: this is conservative, i.e. returns false after any invalidation
+    ///       try_get_resource_content is then cheap for resources that were not affected
     CC_FORCE_INLINE bool is_up_to_date(content_ref const& content) const { return content.generation >= generation; }
     CC_FORCE_INLINE bool is_up_to_date(int gen) const { return gen >= generation; }
 
     // processing API
 public:
-    // NOTE: THIS IS DEBUG API
+    /// starts a pool of worker threads that continuously drain the compute queues
+    /// num_threads < 0 means one worker per hardware thread
+    /// NOTE: workers that are already running are kept (this only adds threads)
+    void start_workers(int num_threads = -1);
+
+    /// stops and joins all worker threads
+    /// NOTE: queued work is kept and can be processed by restarting workers or process_until_idle
+    void stop_workers();
+
+    /// returns the number of currently running worker threads
+    int get_worker_count() const;
+
+    /// blocks until all queued and in-flight work is done
+    /// the calling thread participates in processing
+    /// NOTE: also works without any workers, in which case all work is done on the calling thread
+    void process_until_idle();
+
+    /// same as process_until_idle
+    /// NOTE: kept for compatibility, prefer process_until_idle
     void process_all();
 
+    /// executes all queued computations of executor_id::main_thread on the calling thread
+    /// returns the number of executed computations
+    /// this is meant to be called at a controlled point, e.g. once per frame
+    /// NOTE: does not wait for or help with any other work
+    int process_main_thread_jobs();
+
+    /// sets the executor for computations with the given id
+    /// built-in executors:
+    ///   - cpu and main_thread cannot be replaced
+    ///   - io is a pool of threads that are started on first use (see set_io_thread_count)
+    /// computations of ids without executor are executed on the workers
+    /// NOTE: the executor must stay alive until all of its computations are done
+    void set_executor(executor_id id, cc::unique_ptr<executor> exec);
+
+    /// sets the number of threads of the built-in io executor (4 by default)
+    /// NOTE: only affects the pool if it is not started yet
+    void set_io_thread_count(int num_threads);
+
     // persistence API
 public:
     /// adds all given invocations to the invoc store
-    /// NOTE: not cheap
+    /// NOTE: not cheap, see add_invoc_layer for the lazy alternative
     void inject_invoc_cache(cc::span<cc::pair<base::invoc_hash, base::content_hash> const> invocs);
 
+    /// adds an immutable lookup layer below the invoc store
+    /// lookups consult the invoc store (the delta) first and then all layers in order
+    /// invocations found in a layer are not copied into the invoc store
+    /// NOTE: the layer is not owned, it must stay alive until it is removed (or the resource system is destroyed)
+    void add_invoc_layer(invoc_layer const* layer);
+
+    /// removes a layer added via add_invoc_layer
+    /// blocks until no lookup uses the layer anymore, so it can be destroyed afterwards
+    void remove_invoc_layer(invoc_layer const* layer);
+
     /// returns a vector of all invocations to be persisted but not yet known
-    /// NOTE: not cheap
-    cc::vector<cc::pair<base::invoc_hash, base::content_hash>> collect_all_persistent_invocations(cc::set<base::invoc_hash> const& known_invocs);
+    /// invocations in invoc layers are known (unless the layer has a different content), so this only scans the invoc store (the delta)
+    /// NOTE: not cheap, see drain_new_persistent_invocations for the incremental alternative
+    cc::vector<cc::pair<base::invoc_hash, base::content_hash>> collect_all_persistent_invocations(cc::set<base::invoc_hash> const& known_invocs = {});
+
+    /// returns all invocations to be persisted that were computed since the last call
+    /// the first call returns all of them (like collect_all_persistent_invocations) and starts recording new ones
+    /// thus, the cost of later calls is proportional to the new invocations only
+    /// NOTE: meant for a single consumer (the persistence layer), each invocation is returned once
+    ///       (except for a few that are computed concurrently to the first call)
+    cc::vector<cc::pair<base::invoc_hash, base::content_hash>> drain_new_persistent_invocations();
+
+    /// puts drained invocations back, so that the next drain returns them again
+    /// e.g. if they could not be written (yet)
+    void requeue_persistent_invocations(cc::span<cc::pair<base::invoc_hash, base::content_hash> const> invocs);
 
     /// collect a list of all available content refs (of the given list) that can be persisted
     /// NOTE: not cheap
     cc::vector<content_ref> collect_all_persistent_content(cc::span<base::content_hash const> contents);
 
     /// adds a fallback provider for content
-    /// TODO: lifetime / cleanup
-    void inject_content_provider(cc::unique_function<cc::optional<computation_result>(content_hash)> provider);
+    /// returns an id for remove_content_provider
+    /// NOTE: everything the provider references must stay alive until it is removed (or the resource system is destroyed)
+    content_provider_id inject_content_provider(cc::unique_function<cc::optional<computation_result>(content_hash)> provider);
+
+    /// removes a provider added via inject_content_provider
+    /// blocks until the provider is no longer called
+    void remove_content_provider(content_provider_id id);
+
+    // memory API
+    // content data (runtime + serialized) is refcounted via content_ref
+    // unreferenced content can be evicted and is recomputed (or reloaded from content providers) on demand
+public:
+    /// sets the approximate number of bytes that resident content may use
+    /// once exceeded, unreferenced and unpinned content is evicted (CLOCK policy, i.e. recently used content gets a second chance)
+    /// budget < 0 means unlimited (the default)
+    void set_memory_budget(int64_t budget_bytes);
+    int64_t get_memory_budget() const;
+
+    /// returns the approximate number of bytes of all resident content
+    int64_t get_memory_usage() const;
+
+    /// evicts all content that is currently unreferenced and not pinned (regardless of budget)
+    /// returns the number of freed bytes
+    /// NOTE: not cheap
+    int64_t evict_unused_content();
+
+    /// pinned resources keep their most recent content resident
+    /// pins are counted, i.e. each pin_resource must be matched by an unpin_resource
+    void pin_resource(res_hash res);
+    void unpin_resource(res_hash res);
 
     // internal core operations
     // TODO: does it make sense to expose these?
 private:
     // TODO: error states?
-    cc::optional<content_ref> query_content(content_hash hash, deserialize_fun_ptr deserializer);
+    // returns nullptr if the content is not available (or evicted)
+    // NOTE: the returned desc is pointer-stable
+    // NOTE: the caller owns one reference to the returned content (see content_desc::release)
+    detail::content_desc const* query_content(content_hash hash);
+
+    // same as query_content, but never asks the content providers (i.e. never blocks)
+    detail::content_desc const* query_resident_content(content_hash hash);
 
     // NOTE: this is really fast and does not need DB access
     invoc_hash define_invocation(comp_hash const& computation, cc::span<content_hash const> args);
 
     // NOTE: never returns outdated data
-    cc::optional<content_hash> try_get_resource_content_hash(res_hash res, bool enqueue_if_not_found = true);
+    cc::optional<content_hash> try_get_resource_content_hash(res_hash res, bool enqueue_if_not_found = true, priority prio = priority::normal);
+
+    // NOTE: the returned desc is pointer-stable
+    // NOTE: evicted content is repopulated with comp_result
+    // NOTE: the caller owns one reference to the returned content (see content_desc::release)
+    detail::content_desc const* set_and_get_content_if_new(content_hash hash, computation_result comp_result);
 
-    content_ref set_and_get_content_if_new(content_hash hash, int gen, deserialize_fun_ptr deserializer, computation_result comp_result);
+    // evicts unreferenced content until memory usage is at most target_bytes
+    // if second_chance is true, recently accessed content is skipped once (CLOCK)
+    // returns the number of freed bytes
+    int64_t impl_evict_content(int64_t target_bytes, bool second_chance);
+
+    // registers newly resident content for eviction and evicts if the budget is exceeded
+    void impl_on_content_resident(content_hash hash, int64_t size_bytes);
 
     // queue processing
 private:
     // returns true if one task was processed
-    bool impl_process_queue_res(bool need_content);
+    // NOTE: each processed task must be followed by impl_finish_job()
+    bool impl_process_queue_res(bool need_content, priority prio);
+
+    // pushes a resource to the content or content hash queue of the given priority and wakes up workers
+    void impl_enqueue_res(res_hash res, bool need_content, priority prio);
+    void impl_enqueue_res_many(cc::span<res_hash const> res, bool need_content, priority prio);
+
+    // registers the job (res, need_content, prio) as waiter at all missing args
+    // an arg is ready once it has an up-to-date content hash (or content if wait_for_content)
+    // the job is enqueued again exactly once, namely when the last missing arg is ready
+    void impl_wait_for_args(res_hash res, int gen, bool need_content, bool wait_for_content, priority prio, cc::span<res_hash const> missing_args);
+    // registers the (freshly allocated) waiter at all missing args, see impl_wait_for_args
+    void impl_register_waiter(detail::res_wait_state* state, cc::span<res_hash const> missing_args);
+    void impl_enqueue_ready_waiters(cc::span<detail::res_wait_state* const> waiters);
+
+    // wakes up one sleeping worker (if any) and threads waiting in process_until_idle after new work was queued
+    void impl_wake_worker();
+
+    // marks a previously dequeued job as done (might signal idle)
+    void impl_finish_job();
+
+    // stores the result of a computation (content, invocation, res cache) and wakes up waiting jobs
+    // dynamic_args are the additional args discovered during the computation (see resource_desc::has_dynamic_args)
+    void impl_finish_computation(detail::computation_job const& job, computation_result comp_result, cc::span<cc::pair<res_hash, content_hash> const> dynamic_args = {});
+
+    // makes the invoc hash of a resource with dynamic args from the invoc hash of its static args
+    invoc_hash define_dynamic_invocation(invoc_hash const& static_invoc, cc::span<res_hash const> dynamic_args, cc::span<content_hash const> dynamic_args_content);
+
+    // called by computation_promise::complete
+    // finishes the computation and the pending job of an async computation
+    void impl_complete_async(detail::async_computation* state, computation_result comp_result);
+
+    // called by computation_promise::cancel
+    // finishes the pending job of an async computation without storing anything
+    void impl_cancel_async(detail::async_computation* state);
+
+    // true if the content of res is still needed, see ref_count
+    bool impl_is_needed(res_hash res);
+
+    // drops a job whose result is not needed anymore
+    // the resource can be enqueued again and all its waiters are woken up (and usually cancelled as well)
+    void impl_cancel_job(res_hash res);
+
+    // loads content via the content providers and deserializes it on the io executor, then stores it in the cache of res
+    // if no provider has the content, the job is enqueued again (and then computes it)
+    // NOTE: the calling job stays pending until the task is done
+    void impl_load_content_async(res_hash res, int gen, content_hash hash, deserialize_fun_ptr deserialize, priority prio);
+
+    // runs the computation of an (already pending) async state on the executor of comp
+    // the computation is finished via computation_promise::complete (see impl_complete_async)
+    // NOTE: comp is pointer-stable (computations are never removed)
+    void impl_execute_computation(detail::async_computation* state, computation_desc const& comp);
+
+    // returns true if one task was processed
+    // NOTE: higher priorities first, but with aging so that lower priorities cannot starve
+    bool impl_process_any_job();
+
+    void impl_worker_main();
 
 private:
     // all complex implementation is pimpl'd to keep the header clean
     struct impl;
     cc::unique_ptr<impl> m;
 
-    // generation counter used for O(1) invalidation of locally cached content
+    friend class computation_promise;
+
+    // generation counter, incremented on each invalidation
+    // used for O(1) checks of locally cached content and to order jobs w.r.t. invalidations
     int volatile generation = 1000;
 };
 
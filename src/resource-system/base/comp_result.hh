@@ -2,6 +2,7 @@
 
 #include <clean-core/function_ptr.hh>
 #include <clean-core/optional.hh>
+#include <clean-core/span.hh>
 #include <clean-core/string.hh>
 #include <clean-core/vector.hh>
 
@@ -15,17 +16,65 @@ struct content_serialized_data
 {
     cc::vector<std::byte> blob;
 
+    // alternatively, the bytes can be owned by someone else (e.g. a memory mapped file), see make_external
+    // they stay valid until release_external(external_owner) is called, i.e. until this data is destroyed
+    // NOTE: blob is empty in that case
+    cc::span<std::byte const> external_bytes;
+    void* external_owner = nullptr;
+    cc::function_ptr<void(void*)> release_external = nullptr;
+
+    // NOTE: adopts a reference to owner that is released via release(owner)
+    static content_serialized_data make_external(cc::span<std::byte const> bytes, void* owner, cc::function_ptr<void(void*)> release)
+    {
+        content_serialized_data d;
+        d.external_bytes = bytes;
+        d.external_owner = owner;
+        d.release_external = release;
+        return d;
+    }
+
+    bool is_external() const { return release_external != nullptr; }
+
+    // the serialized bytes, wherever they live
+    cc::span<std::byte const> bytes() const { return is_external() ? external_bytes : cc::span<std::byte const>(blob); }
+
     // noncopyable -> ensure ptr stability
     content_serialized_data() = default;
-    content_serialized_data(content_serialized_data&&) = default;
-    content_serialized_data& operator=(content_serialized_data&&) = default;
+    content_serialized_data(content_serialized_data&& rhs) noexcept
+      : blob(cc::move(rhs.blob)), external_bytes(rhs.external_bytes), external_owner(rhs.external_owner), release_external(rhs.release_external)
+    {
+        rhs.release_external = nullptr;
+    }
+    content_serialized_data& operator=(content_serialized_data&& rhs) noexcept
+    {
+        if (this != &rhs)
+        {
+            if (release_external)
+                release_external(external_owner);
+            blob = cc::move(rhs.blob);
+            external_bytes = rhs.external_bytes;
+            external_owner = rhs.external_owner;
+            release_external = rhs.release_external;
+            rhs.release_external = nullptr;
+        }
+        return *this;
+    }
     content_serialized_data(content_serialized_data const&) = delete;
     content_serialized_data& operator=(content_serialized_data const&) = delete;
+    ~content_serialized_data()
+    {
+        if (release_external)
+            release_external(external_owner);
+    }
 };
 struct content_runtime_data
 {
     void* data_ptr = nullptr;
     cc::function_ptr<void(void*)> deleter = nullptr; // can be nullptr if data_ptr just points into serialized data
+
+    // approximate memory owned by data_ptr (used for the memory budget)
+    // is 0 if unknown or if data_ptr just points into serialized data
+    size_t size_bytes = 0;
 };
 
 using deserialize_fun_ptr = cc::function_ptr<content_runtime_data(cc::span<std::byte const>)>;
@@ -60,12 +109,66 @@ struct computation_result
     computation_result& operator=(computation_result const&) = delete;
 };
 
+namespace detail
+{
+struct content_desc;
+void acquire_content(content_desc const* desc);
+void release_content(content_desc const* desc);
+
+// refcounted pointer to the internal content storage
+// content cannot be evicted while any content_owner references it
+struct content_owner
+{
+    content_desc const* desc = nullptr;
+
+    content_owner() = default;
+    // NOTE: adopts an already acquired reference
+    explicit content_owner(content_desc const* d) : desc(d) {}
+
+    content_owner(content_owner const& rhs) : desc(rhs.desc)
+    {
+        if (desc)
+            acquire_content(desc);
+    }
+    content_owner(content_owner&& rhs) noexcept : desc(rhs.desc) { rhs.desc = nullptr; }
+    content_owner& operator=(content_owner const& rhs)
+    {
+        if (desc != rhs.desc)
+        {
+            if (rhs.desc)
+                acquire_content(rhs.desc);
+            if (desc)
+                release_content(desc);
+            desc = rhs.desc;
+        }
+        return *this;
+    }
+    content_owner& operator=(content_owner&& rhs) noexcept
+    {
+        if (this != &rhs)
+        {
+            if (desc)
+                release_content(desc);
+            desc = rhs.desc;
+            rhs.desc = nullptr;
+        }
+        return *this;
+    }
+    ~content_owner()
+    {
+        if (desc)
+            release_content(desc);
+    }
+};
+} // namespace detail
+
 // TODO: proper states
 //       in memory but not serialized
 //       hash only
 //       serialized but not deserialized
 //       ...
-// TODO: refcounting here?
+// NOTE: content_refs are refcounted
+//       data_ptr, serialized_data, and error_msg stay valid as long as any copy of the ref exists
 struct content_ref
 {
     content_hash hash;
@@ -84,6 +187,9 @@ struct content_ref
     // TODO: more elaborate error type?
     cc::string_view error_msg;
 
+    // [internal] keeps the content alive, i.e. prevents eviction
+    detail::content_owner owner;
+
     bool has_runtime_data() const { return data_ptr != nullptr; }
     bool has_serialized_data() const { return serialized_data.has_value(); }
     bool has_error() const { return data_ptr == nullptr && !serialized_data.has_value(); }
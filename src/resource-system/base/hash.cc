@@ -3,31 +3,32 @@
 #include <chrono>
 #include <thread>
 
-#include <clean-core/hash.sha1.hh>
+#include <clean-core/assert.hh>
 #include <clean-core/intrinsics.hh>
 #include <clean-core/string_view.hh>
+#include <clean-core/utility.hh>
 
 #include <resource-system/detail/hash_helper.hh>
 
 res::base::type_hash res::base::detail::make_type_hash_from_name(char const* name)
 {
-    cc::sha1_builder sha1;
-    sha1.add(cc::as_byte_span(cc::string_view(name)));
-    return res::detail::finalize_as<type_hash>(sha1);
+    res::detail::hash_builder builder;
+    builder.add(cc::as_byte_span(cc::string_view(name)));
+    return res::detail::finalize_as<type_hash>(builder);
 }
 
 res::base::hash res::base::detail::make_random_unique_hash()
 {
     static hash prev_hash = make_type_hash_from_name("globally unique random hash seed");
     static thread_local uint64_t counter = 0;
-    cc::sha1_builder sha1;
-    sha1.add(cc::as_byte_span(prev_hash));
-    sha1.add(cc::as_byte_span(counter));
-    sha1.add(cc::as_byte_span(std::hash<std::thread::id>{}(std::this_thread::get_id())));
-    sha1.add(cc::as_byte_span(cc::intrin_rdtsc()));
-    sha1.add(cc::as_byte_span(std::chrono::high_resolution_clock::now().time_since_epoch().count()));
+    res::detail::hash_builder builder;
+    builder.add(cc::as_byte_span(prev_hash));
+    builder.add(cc::as_byte_span(counter));
+    builder.add(cc::as_byte_span(std::hash<std::thread::id>{}(std::this_thread::get_id())));
+    builder.add(cc::as_byte_span(cc::intrin_rdtsc()));
+    builder.add(cc::as_byte_span(std::chrono::high_resolution_clock::now().time_since_epoch().count()));
 
-    auto h = res::detail::finalize_as<hash>(sha1);
+    auto h = res::detail::finalize_as<hash>(builder);
 
     // NOTE: no sync required
     //       teared reads/writes still provide entropy
@@ -37,3 +38,45 @@ res::base::hash res::base::detail::make_random_unique_hash()
 
     return h;
 }
+
+void res::detail::hash_many(cc::span<cc::span<std::byte const> const> inputs, cc::span<base::hash> out)
+{
+    CC_ASSERT(inputs.size() == out.size());
+
+    auto constexpr lanes = 4;
+
+    size_t i = 0;
+    for (; i + lanes <= inputs.size(); i += lanes)
+    {
+        fast_hash_builder builders[lanes];
+        std::byte const* data[lanes];
+        size_t common_blocks = size_t(-1);
+        for (auto l = 0; l < lanes; ++l)
+        {
+            data[l] = inputs[i + l].data();
+            common_blocks = cc::min(common_blocks, inputs[i + l].size() / 16);
+        }
+
+        // full blocks that all lanes have are mixed in lockstep
+        for (size_t b = 0; b < common_blocks; ++b)
+            for (auto l = 0; l < lanes; ++l)
+            {
+                builders[l].mix_block(data[l] + b * 16);
+            }
+
+        // rest per lane
+        for (auto l = 0; l < lanes; ++l)
+        {
+            builders[l]._total_size = common_blocks * 16;
+            builders[l].add(inputs[i + l].subspan(common_blocks * 16));
+            out[i + l] = builders[l].finalize();
+        }
+    }
+
+    for (; i < inputs.size(); ++i)
+    {
+        fast_hash_builder builder;
+        builder.add(inputs[i]);
+        out[i] = builder.finalize();
+    }
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+
+namespace res::base
+{
+/// scheduling priority of resource requests
+/// jobs of higher priority are processed first
+/// dependencies are computed with the priority of the job that needs them
+/// NOTE: lower priorities still get a share of the workers under load, so they cannot starve
+enum class priority : uint8_t
+{
+    // e.g. prefetching
+    background,
+
+    normal,
+
+    // e.g. visible on screen or blocking user interaction
+    high,
+};
+static constexpr int priority_count = 3;
+} // namespace res::base
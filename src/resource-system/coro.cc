@@ -0,0 +1,49 @@
+#include "coro.hh"
+
+#if defined(__cpp_impl_coroutine)
+
+#include <resource-system/System.hh>
+
+bool res::detail::coro_promise_base::try_add_dynamic_arg(base::res_hash res)
+{
+    auto content = res::system().base().try_get_resource_content(res);
+    if (!content.has_value() || content.value().is_outdated)
+        return false;
+
+    completion.add_dynamic_arg(res, content.value().hash);
+    dynamic_args.push_back(cc::move(content.value()));
+    return true;
+}
+
+void res::detail::coro_promise_base::resume_when_available(base::res_hash res)
+{
+    res::system().base().notify_when_content_available(res,
+                                                       [this, res]
+                                                       {
+                                                           // might be outdated (or evicted) again
+                                                           if (!try_add_dynamic_arg(res))
+                                                           {
+                                                               resume_when_available(res);
+                                                               return;
+                                                           }
+
+                                                           if (dynamic_args.back().has_error())
+                                                               abort("at least one dependency had an error");
+                                                           else
+                                                               self.resume();
+                                                       });
+}
+
+void res::detail::coro_promise_base::abort(cc::string_view message)
+{
+    base::computation_result res;
+    base::content_error_data err;
+    err.message = message;
+    res.error_data = cc::move(err);
+
+    auto c = cc::move(completion);
+    self.destroy();
+    c.complete(cc::move(res));
+}
+
+#endif
@@ -0,0 +1,288 @@
+#pragma once
+
+// coroutine nodes are only available if the compiler supports C++20 coroutines
+#if defined(__cpp_impl_coroutine)
+
+#include <coroutine>
+#include <type_traits>
+
+#include <clean-core/optional.hh>
+#include <clean-core/string_view.hh>
+#include <clean-core/vector.hh>
+
+#include <resource-system/detail/internal_define.hh>
+#include <resource-system/node.hh>
+
+namespace res
+{
+template <class T>
+class coro;
+
+namespace detail
+{
+template <class T>
+struct is_coro : std::false_type
+{
+};
+template <class T>
+struct is_coro<coro<T>> : std::true_type
+{
+};
+
+// the non-templated part of the promise of coroutine nodes
+struct coro_promise_base
+{
+    // completion of the underlying async computation
+    base::computation_promise completion;
+
+    // content of all awaited handles, kept alive until the coroutine is finished
+    cc::vector<base::content_ref> dynamic_args;
+
+    std::coroutine_handle<> self;
+
+    // returns true if res has up-to-date content, which is then appended to dynamic_args
+    // and recorded as dynamic arg of the computation
+    bool try_add_dynamic_arg(base::res_hash res);
+
+    // resumes the coroutine (on a worker) once res has up-to-date content
+    // aborts it if that content has an error
+    // CAUTION: the coroutine might already run (or be dead) when this returns
+    void resume_when_available(base::res_hash res);
+
+    // completes the computation with an error and destroys the coroutine
+    // CAUTION: *this is dead afterwards
+    void abort(cc::string_view message);
+};
+
+// co_await handle<U> -> U const&
+// NOTE: a suspended coroutine does not block any thread
+template <class U>
+struct handle_awaiter
+{
+    coro_promise_base* promise = nullptr;
+    base::res_hash res;
+    bool has_error = false;
+
+    bool await_ready()
+    {
+        if (!promise->try_add_dynamic_arg(res))
+            return false;
+
+        has_error = promise->dynamic_args.back().has_error();
+        return !has_error;
+    }
+    void await_suspend(std::coroutine_handle<>)
+    {
+        // CAUTION: the coroutine (and this awaiter) might be dead after each of these calls
+        if (has_error)
+            promise->abort("at least one dependency had an error");
+        else
+            promise->resume_when_available(res);
+    }
+    U const& await_resume() { return detail::get_resource_arg<U>(promise->dynamic_args.back()); }
+};
+} // namespace detail
+
+/// return type of the functions of coroutine nodes (see node_coro)
+/// T is the result type, i.e. the same as the return type of a normal node function
+///
+/// inside the coroutine, handles can be awaited:
+///   T const& value = co_await some_handle;
+/// this is how dependencies can be discovered while computing
+/// NOTE: coroutines must be deterministic given their args and the content of all awaited handles
+///       (just like normal node functions)
+template <class T>
+class coro
+{
+public:
+    using result_t = T;
+
+    struct promise_type : detail::coro_promise_base
+    {
+        cc::optional<T> result;
+
+        // serializes the result and completes the computation
+        struct final_awaiter
+        {
+            bool await_ready() noexcept { return false; }
+            void await_suspend(std::coroutine_handle<promise_type> h) noexcept
+            {
+                auto& p = h.promise();
+                CC_ASSERT(p.result.has_value() && "coroutine nodes must co_return a value");
+                auto comp_result = detail::make_comp_result<detail::result_to_resource<T>>(cc::move(p.result.value()));
+                auto completion = cc::move(p.completion);
+
+                // the coroutine is destroyed before completion so that all awaited content is released
+                h.destroy();
+                completion.complete(cc::move(comp_result));
+            }
+            void await_resume() noexcept {}
+        };
+
+        coro get_return_object() { return coro(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        final_awaiter final_suspend() noexcept { return {}; }
+        void return_value(T value) { result = cc::move(value); }
+        void unhandled_exception() { CC_UNREACHABLE("exceptions are not supported in coroutine nodes"); }
+
+        // only handles can be awaited
+        template <class U>
+        detail::handle_awaiter<U> await_transform(handle<U> const& h)
+        {
+            return {this, h.get_hash()};
+        }
+    };
+
+    coro(coro&& rhs) noexcept : _handle(rhs._handle) { rhs._handle = nullptr; }
+    coro& operator=(coro&& rhs) noexcept
+    {
+        if (this != &rhs)
+        {
+            if (_handle)
+                _handle.destroy();
+            _handle = rhs._handle;
+            rhs._handle = nullptr;
+        }
+        return *this;
+    }
+    coro(coro const&) = delete;
+    coro& operator=(coro const&) = delete;
+    ~coro()
+    {
+        if (_handle)
+            _handle.destroy();
+    }
+
+    /// runs the coroutine until it's finished or suspended
+    /// the result is passed to completion once finished
+    /// NOTE: afterwards, the coroutine owns itself
+    void start(base::computation_promise completion) &&
+    {
+        CC_ASSERT(_handle && "coroutine already started");
+        auto h = _handle;
+        _handle = nullptr;
+
+        h.promise().completion = cc::move(completion);
+        h.promise().self = h;
+        h.resume();
+    }
+
+private:
+    explicit coro(std::coroutine_handle<promise_type> h) : _handle(h) {}
+
+    std::coroutine_handle<promise_type> _handle;
+};
+
+namespace detail
+{
+template <class FunT, class... Args>
+auto define_res_via_coro(base::hash algo_hash, res_type type, FunT&& fun, Args&&... args)
+{
+    static_assert(std::is_trivially_copyable_v<std::decay_t<FunT>>,                 //
+                  "callables must be POD-like, i.e. all captures must be trivial. " //
+                  "non-trivial captures should be provided as function argument.");
+
+    static_assert(std::is_invocable_v<FunT, arg_to_resource<Args> const&...>, //
+                  "function is not callable with the correct argument types");
+
+    using CoroT = std::decay_t<std::invoke_result_t<FunT, arg_to_resource<Args> const&...>>;
+    static_assert(is_coro<CoroT>::value, "functions of coroutine nodes must return res::coro<T>");
+    using ResultT = typename CoroT::result_t;
+    static_assert(!is_handle<ResultT>::value, "TODO: implement indirect resources");
+    using ResourceT = result_to_resource<ResultT>;
+
+    // collect resource handles
+    auto constexpr res_arg_count = sizeof...(args);
+    base::res_hash res_args[res_arg_count > 0 ? res_arg_count : 1]; // the max(1,..) is to prevent zero sized arrays
+    base::res_hash* p_res_args = res_args;
+    ((*p_res_args++ = detail::wrap_to_handle(cc::forward<Args>(args)).get_hash()), ...);
+
+    base::computation_desc comp_desc;
+    comp_desc.algo_hash = algo_hash;
+    comp_desc.type_hash = detail::get_arg_type_hash<arg_to_resource<Args>...>();
+    // NOTE: the coroutine may reference captures of fun, which lives as long as the computation
+    comp_desc.compute_resource_async = [fun = cc::move(fun)] //
+        (cc::span<base::content_ref const> res_args, base::computation_promise completion)
+    {
+        CC_ASSERT(res_args.size() == sizeof...(Args) && "wrong number of inputs");
+
+        // if any arg is missing, result is error
+        for (auto const& arg : res_args)
+            if (arg.has_error())
+            {
+                base::computation_result res;
+                base::content_error_data err;
+                err.message = "at least one dependency had an error";
+                res.error_data = cc::move(err);
+                completion.complete(cc::move(res));
+                return;
+            }
+
+        // creates the (suspended) coroutine and runs it until the first suspension
+        auto c = res_evaluator<std::make_index_sequence<sizeof...(Args)>> //
+            ::template eval<std::decay_t<FunT>, arg_to_resource<Args>...>(fun, res_args);
+        cc::move(c).start(cc::move(completion));
+    };
+
+    auto is_volatile = type == res_type::volatile_;
+    auto is_persisted = type == res_type::normal;
+    auto has_dynamic_args = true;
+    auto slot = detail::get_or_create_resource_slot(cc::move(comp_desc), cc::span<base::res_hash>(res_args, res_arg_count), is_volatile, is_persisted,
+                                                    has_dynamic_args, resource_traits<ResourceT>::make_deserialize());
+    return slot->template create_handle<ResourceT>();
+}
+} // namespace detail
+
+template <class Fun>
+class CoroNode : public Node
+{
+public:
+    CoroNode(Fun fun, base::hash algo_hash, detail::res_type type) : fun(cc::move(fun)), algo_hash(algo_hash), type(type) {}
+
+    template <class... Args>
+    auto define_resource(Args&&... args)
+    {
+        return detail::define_res_via_coro(algo_hash, type, fun, cc::forward<Args>(args)...);
+    }
+
+private:
+    Fun fun;
+    base::hash algo_hash;
+    detail::res_type type;
+};
+
+/// a coroutine node can discover its dependencies while being computed
+/// its function returns res::coro<T> and can co_await handles
+///
+/// usage:
+///
+///   auto load_scene = res::node_coro([](cc::string_view path) -> res::coro<scene>
+///   {
+///       scene s = parse_scene(path);
+///       for (auto const& mesh_path : s.mesh_paths)
+///           s.meshes.push_back(co_await res::define(load_mesh, mesh_path));
+///       co_return s;
+///   });
+///
+/// NOTE: awaited handles are recorded as dynamic args of the resource
+///       the invocation cache takes their content into account
+/// NOTE: a suspended coroutine does not block a worker
+/// NOTE: the name must be _globally_ unique (see res::node)
+/// NOTE: unlike res::node, results are not persisted across runs (e.g. by a persistent store)
+///       the recorded dynamic args are runtime-only, so the invocation cannot be restored
+///       name and version still identify the computation, i.e. equal nodes share results within a run
+template <class FunT>
+auto node_coro(cc::string_view name, int version, FunT&& fun)
+{
+    detail::register_node_name(name);
+    return CoroNode<std::decay_t<FunT>>(cc::forward<FunT>(fun), detail::make_name_version_algo_hash(name, version), detail::res_type::normal);
+}
+/// runtime version of node_coro, see res::node_runtime
+template <class FunT>
+auto node_coro(FunT&& fun)
+{
+    return CoroNode<std::decay_t<FunT>>(cc::forward<FunT>(fun), base::make_random_unique_hash(), detail::res_type::runtime);
+}
+} // namespace res
+
+#endif
@@ -0,0 +1,427 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <memory>
+#include <new>
+#include <type_traits>
+
+#include <clean-core/allocate.hh>
+#include <clean-core/assert.hh>
+#include <clean-core/forward.hh>
+#include <clean-core/move.hh>
+
+#include <resource-system/base/hash.hh>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RES_FLAT_HASH_MAP_SSE2 1
+#include <emmintrin.h>
+#else
+#define RES_FLAT_HASH_MAP_SSE2 0
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace res::detail
+{
+/// an open-addressing hash map specialized for the 128 bit hashes of the resource system
+///
+/// - keys are already uniformly distributed (SHA1 words), so no hash function is applied
+///   the group index is taken from the lower bits of w0, a 7 bit tag from w1
+///   (the upper bits of w0 are used for shard selection in MemoryStore)
+/// - swiss-table-style groups of 16 control bytes, matched via SSE2 if available
+/// - keys and small values are stored inline
+///   large or non-movable values are boxed, i.e. pointers to them are stable (see has_stable_values)
+/// - growing never recomputes any hash, entries are reinserted based on their key bits
+///
+/// NOTE: not threadsafe
+template <class KeyT, class ValueT>
+class flat_hash_map
+{
+    static_assert(std::is_base_of_v<base::hash, KeyT>, "only for resource system hashes");
+
+    static constexpr bool is_inline = sizeof(ValueT) <= 32 && std::is_nothrow_move_constructible_v<ValueT>;
+    using storage_t = std::conditional_t<is_inline, ValueT, ValueT*>;
+
+    static constexpr size_t group_size = 16;
+
+    // control bytes: full slots store the 7 bit tag, special slots have the high bit set
+    static constexpr int8_t ctrl_empty = -128; // 0x80
+    static constexpr int8_t ctrl_deleted = -2; // 0xFE
+
+public:
+    /// true if pointers to values stay valid until they are removed (i.e. values are boxed)
+    static constexpr bool has_stable_values = !is_inline;
+
+    template <class V>
+    struct entry
+    {
+        KeyT const& key;
+        V& value;
+    };
+
+    template <bool IsConst>
+    struct iterator_t
+    {
+        using map_t = std::conditional_t<IsConst, flat_hash_map const, flat_hash_map>;
+        using value_t = std::conditional_t<IsConst, ValueT const, ValueT>;
+
+        map_t* map;
+        size_t idx;
+
+        entry<value_t> operator*() const
+        {
+            auto& s = map->_slots[idx];
+            return {s.key, map->value_of(s)};
+        }
+        iterator_t& operator++()
+        {
+            ++idx;
+            skip_to_full();
+            return *this;
+        }
+        bool operator!=(iterator_t const& rhs) const { return idx != rhs.idx; }
+        bool operator==(iterator_t const& rhs) const { return idx == rhs.idx; }
+
+        void skip_to_full()
+        {
+            while (idx < map->_capacity && map->_ctrl[idx] < 0)
+                ++idx;
+        }
+    };
+    using iterator = iterator_t<false>;
+    using const_iterator = iterator_t<true>;
+
+public:
+    flat_hash_map() = default;
+    ~flat_hash_map() { destroy(); }
+
+    flat_hash_map(flat_hash_map&& rhs) noexcept { steal(rhs); }
+    flat_hash_map& operator=(flat_hash_map&& rhs) noexcept
+    {
+        if (this != &rhs)
+        {
+            destroy();
+            steal(rhs);
+        }
+        return *this;
+    }
+    flat_hash_map(flat_hash_map const&) = delete;
+    flat_hash_map& operator=(flat_hash_map const&) = delete;
+
+    size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+
+    ValueT* get_ptr(KeyT const& key)
+    {
+        auto idx = find(key);
+        return idx == npos ? nullptr : &value_of(_slots[idx]);
+    }
+    ValueT const* get_ptr(KeyT const& key) const
+    {
+        auto idx = find(key);
+        return idx == npos ? nullptr : &value_of(_slots[idx]);
+    }
+    bool contains_key(KeyT const& key) const { return find(key) != npos; }
+
+    /// returns the value for key, creating it via create_f() if not found
+    template <class CreateF>
+    ValueT& get_or_create(KeyT const& key, CreateF&& create_f)
+    {
+        if (auto idx = find(key); idx != npos)
+            return value_of(_slots[idx]);
+
+        reserve_one();
+        auto idx = insert_slot(key);
+        auto& s = _slots[idx];
+        new (&s.key) KeyT(key);
+        if constexpr (is_inline)
+            new (&s.value) ValueT(create_f());
+        else
+            new (&s.value) storage_t(cc::alloc<ValueT>(create_f()));
+        ++_size;
+        return value_of(s);
+    }
+
+    ValueT& operator[](KeyT const& key)
+    {
+        return get_or_create(key, [] { return ValueT(); });
+    }
+
+    /// returns true if the key was found (and removed)
+    bool remove_key(KeyT const& key)
+    {
+        auto idx = find(key);
+        if (idx == npos)
+            return false;
+
+        destroy_slot(_slots[idx]);
+        _ctrl[idx] = ctrl_deleted;
+        --_size;
+        ++_deleted;
+        return true;
+    }
+
+    void clear()
+    {
+        destroy();
+        _ctrl = ctrl_ptr();
+        _slots = nullptr;
+        _capacity = 0;
+        _size = 0;
+        _deleted = 0;
+    }
+
+    iterator begin()
+    {
+        iterator it{this, 0};
+        it.skip_to_full();
+        return it;
+    }
+    iterator end() { return {this, _capacity}; }
+    const_iterator begin() const
+    {
+        const_iterator it{this, 0};
+        it.skip_to_full();
+        return it;
+    }
+    const_iterator end() const { return {this, _capacity}; }
+
+private:
+    struct slot
+    {
+        KeyT key;
+        storage_t value;
+    };
+    // uninitialized slot memory
+    struct alignas(slot) slot_storage
+    {
+        std::byte data[sizeof(slot)];
+    };
+    struct alignas(group_size) ctrl_group
+    {
+        int8_t bytes[group_size];
+    };
+
+    static constexpr size_t npos = size_t(-1);
+
+    static ValueT& value_of(slot& s)
+    {
+        if constexpr (is_inline)
+            return s.value;
+        else
+            return *s.value;
+    }
+    static ValueT const& value_of(slot const& s)
+    {
+        if constexpr (is_inline)
+            return s.value;
+        else
+            return *s.value;
+    }
+
+    static int8_t tag_of(KeyT const& key) { return int8_t(key.w1 & 0x7F); }
+
+    static int count_trailing_zeros(uint32_t v)
+    {
+        CC_ASSERT(v != 0);
+#ifdef _MSC_VER
+        unsigned long idx;
+        _BitScanForward(&idx, v);
+        return int(idx);
+#else
+        return __builtin_ctz(v);
+#endif
+    }
+
+    // bitmask of all bytes in the group that are equal to v
+    static uint32_t match_byte(int8_t const* group, int8_t v)
+    {
+#if RES_FLAT_HASH_MAP_SSE2
+        auto const g = _mm_load_si128(reinterpret_cast<__m128i const*>(group));
+        return uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(v))));
+#else
+        uint32_t mask = 0;
+        for (size_t i = 0; i < group_size; ++i)
+            if (group[i] == v)
+                mask |= 1u << i;
+        return mask;
+#endif
+    }
+    // bitmask of all empty or deleted bytes in the group
+    static uint32_t match_free(int8_t const* group)
+    {
+#if RES_FLAT_HASH_MAP_SSE2
+        return uint32_t(_mm_movemask_epi8(_mm_load_si128(reinterpret_cast<__m128i const*>(group))));
+#else
+        uint32_t mask = 0;
+        for (size_t i = 0; i < group_size; ++i)
+            if (group[i] < 0)
+                mask |= 1u << i;
+        return mask;
+#endif
+    }
+
+    size_t group_mask() const { return _capacity / group_size - 1; }
+
+    size_t find(KeyT const& key) const
+    {
+        if (_size == 0)
+            return npos;
+
+        auto const tag = tag_of(key);
+        auto const gmask = group_mask();
+        auto g = size_t(key.w0) & gmask;
+
+        // triangular probing visits every group exactly once
+        for (size_t probe = 1; probe <= gmask + 1; ++probe)
+        {
+            auto const group = _ctrl.get() + g * group_size;
+
+            for (auto m = match_byte(group, tag); m != 0; m &= m - 1)
+            {
+                auto const idx = g * group_size + count_trailing_zeros(m);
+                if (_slots[idx].key == key)
+                    return idx;
+            }
+
+            if (match_byte(group, ctrl_empty) != 0)
+                return npos;
+
+            g = (g + probe) & gmask;
+        }
+
+        return npos;
+    }
+
+    // returns index of a free slot for a key that is known to be not present
+    // and marks it as used
+    size_t insert_slot(KeyT const& key)
+    {
+        auto const gmask = group_mask();
+        auto g = size_t(key.w0) & gmask;
+
+        for (size_t probe = 1; probe <= gmask + 1; ++probe)
+        {
+            auto const group = _ctrl.get() + g * group_size;
+            if (auto m = match_free(group); m != 0)
+            {
+                auto const idx = g * group_size + count_trailing_zeros(m);
+                if (_ctrl[idx] == ctrl_deleted)
+                    --_deleted;
+                _ctrl[idx] = tag_of(key);
+                return idx;
+            }
+
+            g = (g + probe) & gmask;
+        }
+
+        CC_UNREACHABLE("reserve_one guarantees a free slot");
+        return npos;
+    }
+
+    // ensures that one more element can be inserted
+    // max load factor (including tombstones) is 7/8
+    void reserve_one()
+    {
+        if ((_size + _deleted + 1) * 8 <= _capacity * 7)
+            return;
+
+        // rehash with the same capacity if this just cleans up tombstones, otherwise double
+        auto new_capacity = _capacity == 0 ? group_size : _capacity;
+        if ((_size + 1) * 2 > _capacity)
+            new_capacity = _capacity == 0 ? group_size : _capacity * 2;
+
+        rehash(new_capacity);
+    }
+
+    void rehash(size_t new_capacity)
+    {
+        CC_ASSERT(new_capacity % group_size == 0 && ((new_capacity / group_size) & (new_capacity / group_size - 1)) == 0);
+
+        auto old_ctrl = cc::move(_ctrl);
+        auto old_slots = cc::move(_slots);
+        auto const old_capacity = _capacity;
+
+        _capacity = new_capacity;
+        _deleted = 0;
+        _ctrl = std::make_unique<ctrl_group[]>(_capacity / group_size);
+        std::memset(_ctrl.get(), ctrl_empty, _capacity);
+        _slots = reinterpret_cast<slot*>(new slot_storage[_capacity]);
+
+        // reinsert, no hashing and no key comparisons required
+        for (size_t i = 0; i < old_capacity; ++i)
+        {
+            if (old_ctrl.get()[i] < 0)
+                continue;
+
+            auto& old_s = old_slots[i];
+            auto idx = insert_slot(old_s.key);
+            auto& s = _slots[idx];
+            new (&s.key) KeyT(old_s.key);
+            new (&s.value) storage_t(cc::move(old_s.value));
+            old_s.value.~storage_t();
+        }
+
+        delete[] reinterpret_cast<slot_storage*>(old_slots);
+    }
+
+    void destroy_slot(slot& s)
+    {
+        if constexpr (is_inline)
+            s.value.~ValueT();
+        else
+            cc::free(s.value);
+    }
+
+    void destroy()
+    {
+        if (_slots == nullptr)
+            return;
+
+        for (size_t i = 0; i < _capacity; ++i)
+            if (_ctrl[i] >= 0)
+                destroy_slot(_slots[i]);
+
+        delete[] reinterpret_cast<slot_storage*>(_slots);
+        _slots = nullptr;
+    }
+
+    void steal(flat_hash_map& rhs)
+    {
+        _ctrl = cc::move(rhs._ctrl);
+        _slots = rhs._slots;
+        _capacity = rhs._capacity;
+        _size = rhs._size;
+        _deleted = rhs._deleted;
+
+        rhs._slots = nullptr;
+        rhs._capacity = 0;
+        rhs._size = 0;
+        rhs._deleted = 0;
+    }
+
+private:
+    // accessed as int8_t array, allocated as groups for alignment
+    struct ctrl_ptr
+    {
+        std::unique_ptr<ctrl_group[]> groups;
+
+        ctrl_ptr() = default;
+        ctrl_ptr(std::unique_ptr<ctrl_group[]> g) : groups(cc::move(g)) {}
+
+        int8_t* get() const { return groups ? groups[0].bytes : nullptr; }
+        int8_t& operator[](size_t i) const { return get()[i]; }
+    };
+
+    ctrl_ptr _ctrl;
+    slot* _slots = nullptr;
+    size_t _capacity = 0; // multiple of group_size, number of groups is a power of two
+    size_t _size = 0;
+    size_t _deleted = 0;
+};
+} // namespace res::detail
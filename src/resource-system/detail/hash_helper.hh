@@ -1,11 +1,176 @@
 #pragma once
 
+#include <cstdint>
+#include <cstring>
+
 #include <clean-core/hash.sha1.hh>
+#include <clean-core/span.hh>
 
 #include <resource-system/base/hash.hh>
 
+// hash backend used to derive comp/res/invoc/type hashes
+// selected at build time:
+//   RES_HASH_BACKEND_SHA1 = 1 -> cc::sha1_builder
+//   RES_HASH_BACKEND_SHA1 = 0 -> fast_hash_builder (default)
+// NOTE: content hashes are not affected by this
+// NOTE: the backends produce different hashes, so persisted data is tagged with hash_format_tag
+#ifndef RES_HASH_BACKEND_SHA1
+#define RES_HASH_BACKEND_SHA1 0
+#endif
+
 namespace res::detail
 {
+/// a fast, non-cryptographic streaming 128 bit hash
+/// (MurmurHash3 x64_128 construction, see https://github.com/aappleby/smhasher)
+///
+/// NOTE: this is not collision-resistant against adversarial inputs
+///       but for our non-adversarial keys it behaves like a random 128 bit function
+///       which keeps the collision budget documented in base/hash.hh
+/// NOTE: add(a); add(b); is equivalent to add(a ++ b);
+struct fast_hash_builder
+{
+    void add(cc::span<std::byte const> data)
+    {
+        auto p = data.data();
+        auto size = data.size();
+        _total_size += size;
+
+        // complete pending partial block
+        if (_tail_size > 0)
+        {
+            auto const n = size < 16 - _tail_size ? size : 16 - _tail_size;
+            std::memcpy(_tail + _tail_size, p, n);
+            _tail_size += n;
+            p += n;
+            size -= n;
+
+            if (_tail_size < 16)
+                return;
+
+            mix_block(_tail);
+            _tail_size = 0;
+        }
+
+        // full blocks
+        while (size >= 16)
+        {
+            mix_block(p);
+            p += 16;
+            size -= 16;
+        }
+
+        // remember rest
+        std::memcpy(_tail, p, size);
+        _tail_size = size;
+    }
+
+    base::hash finalize()
+    {
+        // tail (zero padded)
+        std::memset(_tail + _tail_size, 0, 16 - _tail_size);
+        auto k1 = load64(_tail);
+        auto k2 = load64(_tail + 8);
+        if (_tail_size > 8)
+        {
+            k2 *= c2;
+            k2 = rotl(k2, 33);
+            k2 *= c1;
+            _h2 ^= k2;
+        }
+        if (_tail_size > 0)
+        {
+            k1 *= c1;
+            k1 = rotl(k1, 31);
+            k1 *= c2;
+            _h1 ^= k1;
+        }
+
+        // finalization
+        _h1 ^= _total_size;
+        _h2 ^= _total_size;
+        _h1 += _h2;
+        _h2 += _h1;
+        _h1 = fmix64(_h1);
+        _h2 = fmix64(_h2);
+        _h1 += _h2;
+        _h2 += _h1;
+
+        base::hash h;
+        h.w0 = _h1;
+        h.w1 = _h2;
+        return h;
+    }
+
+private:
+    static constexpr uint64_t c1 = 0x87c37b91114253d5uLL;
+    static constexpr uint64_t c2 = 0x4cf5ad432745937fuLL;
+
+    static uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+    static uint64_t load64(std::byte const* p)
+    {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+    static uint64_t fmix64(uint64_t k)
+    {
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccduLL;
+        k ^= k >> 33;
+        k *= 0xc4ceb9fe1a85ec53uLL;
+        k ^= k >> 33;
+        return k;
+    }
+
+    void mix_block(std::byte const* p)
+    {
+        auto k1 = load64(p);
+        auto k2 = load64(p + 8);
+
+        k1 *= c1;
+        k1 = rotl(k1, 31);
+        k1 *= c2;
+        _h1 ^= k1;
+
+        _h1 = rotl(_h1, 27);
+        _h1 += _h2;
+        _h1 = _h1 * 5 + 0x52dce729;
+
+        k2 *= c2;
+        k2 = rotl(k2, 33);
+        k2 *= c1;
+        _h2 ^= k2;
+
+        _h2 = rotl(_h2, 31);
+        _h2 += _h1;
+        _h2 = _h2 * 5 + 0x38495ab5;
+    }
+
+    // arbitrary fixed seed
+    uint64_t _h1 = 0x2A9F4C61D3E57B08uLL;
+    uint64_t _h2 = 0x2A9F4C61D3E57B08uLL;
+    std::byte _tail[16];
+    size_t _tail_size = 0;
+    uint64_t _total_size = 0;
+
+    friend void hash_many(cc::span<cc::span<std::byte const> const> inputs, cc::span<base::hash> out);
+};
+
+/// computes fast_hash_builder hashes of many (usually short) inputs at once
+/// inputs are processed in interleaved lanes so that the independent multiply chains can be pipelined (e.g. for ResourceSystem::define_resources)
+/// NOTE: out[i] is the same as hashing inputs[i] with a single add call
+void hash_many(cc::span<cc::span<std::byte const> const> inputs, cc::span<base::hash> out);
+
+#if RES_HASH_BACKEND_SHA1
+using hash_builder = cc::sha1_builder;
+#else
+using hash_builder = fast_hash_builder;
+#endif
+
+/// identifies the hash backend (and the derivation of persisted hashes)
+/// persisted data with a different tag is not compatible
+inline constexpr uint32_t hash_format_tag = RES_HASH_BACKEND_SHA1 ? 0x31414853 /* "SHA1" */ : 0x3346334D /* "M3F3" */;
+
 template <class HashT>
 HashT finalize_as(cc::sha1_builder& b)
 {
@@ -15,4 +180,14 @@ HashT finalize_as(cc::sha1_builder& b)
     std::memcpy(&hash, &sha1_value, sizeof(hash));
     return hash;
 }
+
+template <class HashT>
+HashT finalize_as(fast_hash_builder& b)
+{
+    static_assert(sizeof(base::hash) == sizeof(HashT));
+    auto const h = b.finalize();
+    HashT hash;
+    std::memcpy(&hash, &h, sizeof(hash));
+    return hash;
+}
 } // namespace res::detail
@@ -7,8 +7,6 @@
 #include <clean-core/move.hh>
 #include <clean-core/tuple.hh>
 
-#include <clean-core/hash.sha1.hh>
-
 // TODO: slim down to the api part we need
 #include <resource-system/base/api.hh>
 
@@ -27,8 +25,12 @@
 
 namespace res::detail
 {
-resource_slot* get_or_create_resource_slot(
-    res::base::computation_desc desc, cc::span<res::base::res_hash const> args, bool is_volatile, bool is_persisted, base::deserialize_fun_ptr deserialize);
+resource_slot* get_or_create_resource_slot(res::base::computation_desc desc,
+                                           cc::span<res::base::res_hash const> args,
+                                           bool is_volatile,
+                                           bool is_persisted,
+                                           bool has_dynamic_args,
+                                           base::deserialize_fun_ptr deserialize);
 
 enum class res_type
 {
@@ -111,7 +113,9 @@ auto define_constant(T value) -> handle<const_to_resource<T>>
 
     auto is_volatile = false;
     auto is_persisted = false;
-    auto slot = detail::get_or_create_resource_slot(cc::move(comp_desc), {}, is_volatile, is_persisted, resource_traits<ResourceT>::make_deserialize());
+    auto has_dynamic_args = false;
+    auto slot = detail::get_or_create_resource_slot(cc::move(comp_desc), {}, is_volatile, is_persisted, has_dynamic_args,
+                                                    resource_traits<ResourceT>::make_deserialize());
     return slot->template create_handle<ResourceT>();
 }
 
@@ -129,15 +133,15 @@ base::hash get_arg_type_hash()
 {
     static base::hash hash = []
     {
-        cc::sha1_builder sha1;
-        (sha1.add(cc::as_byte_span(base::get_type_hash<ResArgs>())), ...);
-        return detail::finalize_as<base::hash>(sha1);
+        detail::hash_builder builder;
+        (builder.add(cc::as_byte_span(base::get_type_hash<ResArgs>())), ...);
+        return detail::finalize_as<base::hash>(builder);
     }();
     return hash;
 }
 
 template <class FunT, class... Args>
-auto define_res_via_lambda(base::hash algo_hash, res_type type, FunT&& fun, Args&&... args)
+auto define_res_via_lambda(base::hash algo_hash, res_type type, base::executor_id executor, FunT&& fun, Args&&... args)
 {
     static_assert(std::is_trivially_copyable_v<std::decay_t<FunT>>,                 //
                   "callables must be POD-like, i.e. all captures must be trivial. " //
@@ -159,6 +163,7 @@ auto define_res_via_lambda(base::hash algo_hash, res_type type, FunT&& fun, Args
     base::computation_desc comp_desc;
     comp_desc.algo_hash = algo_hash;
     comp_desc.type_hash = detail::get_arg_type_hash<arg_to_resource<Args>...>();
+    comp_desc.executor = executor;
     comp_desc.compute_resource = [fun = cc::move(fun)] //
         (cc::span<base::content_ref const> res_args) -> base::computation_result
     {
@@ -185,8 +190,9 @@ auto define_res_via_lambda(base::hash algo_hash, res_type type, FunT&& fun, Args
 
     auto is_volatile = type == res_type::volatile_;
     auto is_persisted = type == res_type::normal;
+    auto has_dynamic_args = false;
     auto slot = detail::get_or_create_resource_slot(cc::move(comp_desc), cc::span<base::res_hash>(res_args, res_arg_count), is_volatile, is_persisted,
-                                                    resource_traits<ResourceT>::make_deserialize());
+                                                    has_dynamic_args, resource_traits<ResourceT>::make_deserialize());
     return slot->template create_handle<ResourceT>();
 }
 } // namespace res::detail
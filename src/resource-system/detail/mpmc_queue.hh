@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+
+#include <clean-core/assert.hh>
+#include <clean-core/experimental/ringbuffer.hh>
+#include <clean-core/move.hh>
+
+namespace res::detail
+{
+/// a growable multi-producer multi-consumer queue
+///
+/// - fast path is a lock-free bounded ring (D. Vyukov's MPMC queue)
+/// - if the ring is full, elements spill into a mutexed, growing ringbuffer
+/// - while the spill buffer is non-empty, producers also push there
+///   so the ring drains and spilled elements cannot starve
+///
+/// NOTE: push never fails, i.e. everything pushed will eventually be popped
+/// NOTE: order is FIFO as long as nothing spills
+template <class T>
+class mpmc_queue
+{
+    static_assert(std::is_nothrow_move_assignable_v<T> && std::is_default_constructible_v<T>);
+
+public:
+    /// capacity of the lock-free part, must be a power of two
+    explicit mpmc_queue(size_t capacity = 1 << 14) : _mask(capacity - 1)
+    {
+        CC_ASSERT(capacity >= 2 && (capacity & (capacity - 1)) == 0 && "capacity must be a power of two");
+
+        _cells = std::make_unique<cell[]>(capacity);
+        for (size_t i = 0; i < capacity; ++i)
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    mpmc_queue(mpmc_queue const&) = delete;
+    mpmc_queue& operator=(mpmc_queue const&) = delete;
+
+    void push(T value)
+    {
+        if (_spill_count.load() == 0 && try_push_ring(value))
+            return;
+
+        auto lock = std::lock_guard{_spill_mutex};
+        _spill.push_back(cc::move(value));
+        _spill_count.fetch_add(1);
+    }
+
+    /// returns false if the queue was empty
+    bool try_pop(T& out)
+    {
+        if (try_pop_ring(out))
+            return true;
+
+        if (_spill_count.load() == 0)
+            return false;
+
+        auto lock = std::lock_guard{_spill_mutex};
+        if (_spill.empty())
+            return false;
+
+        out = _spill.pop_front();
+        _spill_count.fetch_sub(1);
+        return true;
+    }
+
+    /// NOTE: only a snapshot in a concurrent setting
+    bool empty_approx() const
+    {
+        return _spill_count.load() == 0 && _dequeue_pos.load(std::memory_order_relaxed) >= _enqueue_pos.load(std::memory_order_relaxed);
+    }
+
+private:
+    bool try_push_ring(T& value)
+    {
+        cell* c;
+        auto pos = _enqueue_pos.load(std::memory_order_relaxed);
+        while (true)
+        {
+            c = &_cells[pos & _mask];
+            auto const seq = c->sequence.load(std::memory_order_acquire);
+            auto const diff = intptr_t(seq) - intptr_t(pos);
+            if (diff == 0)
+            {
+                if (_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+                return false; // full
+            else
+                pos = _enqueue_pos.load(std::memory_order_relaxed);
+        }
+
+        c->value = cc::move(value);
+        c->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop_ring(T& out)
+    {
+        cell* c;
+        auto pos = _dequeue_pos.load(std::memory_order_relaxed);
+        while (true)
+        {
+            c = &_cells[pos & _mask];
+            auto const seq = c->sequence.load(std::memory_order_acquire);
+            auto const diff = intptr_t(seq) - intptr_t(pos + 1);
+            if (diff == 0)
+            {
+                if (_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+                return false; // empty
+            else
+                pos = _dequeue_pos.load(std::memory_order_relaxed);
+        }
+
+        out = cc::move(c->value);
+        c->sequence.store(pos + _mask + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    struct cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<cell[]> _cells;
+    size_t const _mask;
+
+    // separate cache lines to prevent false sharing between producers and consumers
+    alignas(64) std::atomic<size_t> _enqueue_pos = 0;
+    alignas(64) std::atomic<size_t> _dequeue_pos = 0;
+
+    alignas(64) std::atomic<size_t> _spill_count = 0;
+    std::mutex _spill_mutex;
+    cc::ringbuffer<T> _spill;
+};
+} // namespace res::detail
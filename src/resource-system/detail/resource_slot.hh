@@ -1,6 +1,10 @@
 #pragma once
 
+#include <atomic>
 #include <cstddef>
+#include <mutex>
+
+#include <clean-core/vector.hh>
 
 #include <resource-system/base/api.hh>
 #include <resource-system/fwd.hh>
@@ -9,19 +13,31 @@ namespace res::detail
 {
 struct resource_slot
 {
+    // references of the resource, i.e. the number of handles
+    // NOTE: the slot itself holds no reference, so resources without handles can be cancelled (see base::ref_count)
     // CAUTION: must be first location
-    int volatile ref_count = 1;
+    base::ref_count* resource_ref_count = nullptr;
 
-    int cached_gen = -1;
+    // generation and data_ptr of cached_content, read by try_get without locking
+    // NOTE: cached_data is published before cached_gen, so an up-to-date generation implies its data
+    std::atomic<int> cached_gen = -1;
+    std::atomic<void const*> cached_data = nullptr;
 
     // backreference to resource system
     System* system = nullptr;
 
     base::res_hash resource;
 
-    void const* cached_value = nullptr;
+    // guards cached_content and replaced_contents, i.e. serializes updates of the cache of this slot
+    std::mutex cache_mutex;
 
-    base::ref_count* resource_ref_count = nullptr;
+    // keeps the cached content alive (i.e. prevents eviction)
+    // data_ptr is nullptr if not loaded
+    base::content_ref cached_content;
+
+    // previously cached contents, kept alive until the next collect_garbage
+    // so that pointers returned by try_get stay valid when another thread updates the cache
+    cc::vector<base::content_ref> replaced_contents;
 
     template <class T>
     handle<T> create_handle()
@@ -29,5 +45,6 @@ struct resource_slot
         return handle<T>(this);
     }
 };
-static_assert(offsetof(resource_slot, ref_count) == 0, "we assume opaquely that the first member is the ref count");
+static_assert(offsetof(resource_slot, resource_ref_count) == 0, "we assume opaquely that the first member is the ref count");
+static_assert(offsetof(base::ref_count, count) == 0, "we assume opaquely that the first member is the ref count");
 } // namespace res::detail
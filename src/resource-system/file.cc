@@ -1,5 +1,7 @@
 #include "file.hh"
 
+#include <mutex>
+
 #include <clean-core/experimental/filewatch.hh>
 #include <clean-core/map.hh>
 
@@ -16,6 +18,8 @@ res::base::hash res::FileNode::algo_hash = res::detail::make_name_version_algo_h
 
 struct res::FileNode::state
 {
+    // NOTE: files are loaded concurrently on the io executor
+    std::mutex mutex; // guards reloads
     cc::map<cc::string, cc::filewatch> reloads;
 };
 
@@ -25,6 +29,7 @@ void res::FileNode::set_hot_reloading(bool enabled) { _hot_reload_enabled = enab
 
 void res::FileNode::check_hot_reloading()
 {
+    auto lock = std::lock_guard{_state->mutex};
     for (auto&& [fname, fwatch] : _state->reloads)
         if (fwatch.has_changed())
         {
@@ -77,6 +82,7 @@ void res::FileNode::enable_hot_reloading_for(cc::string_view filename) const
     if (!_hot_reload_enabled)
         return;
 
+    auto lock = std::lock_guard{_state->mutex};
     auto& fwatch = _state->reloads[filename];
     if (fwatch.is_valid())
         return;
@@ -54,8 +54,9 @@ public:
     auto define_resource(Args&&... args)
     {
         // TODO impure part
+        // NOTE: disk reads are executed on the io pool so that they overlap with cpu work
         return detail::define_res_via_lambda(
-            algo_hash, detail::res_type::normal, [](auto&&... args) { return file.execute(args...); }, cc::forward<Args>(args)...);
+            algo_hash, detail::res_type::normal, executor_id::io, [](auto&&... args) { return file.execute(args...); }, cc::forward<Args>(args)...);
     }
 
 private:
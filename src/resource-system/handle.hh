@@ -1,8 +1,11 @@
 #pragma once
 
 #include <clean-core/assert.hh>
+#include <clean-core/function_ref.hh>
+#include <clean-core/span.hh>
 
 #include <resource-system/base/hash.hh>
+#include <resource-system/base/priority.hh>
 #include <resource-system/fwd.hh>
 
 // TODO: how expensive if this header?
@@ -14,7 +17,8 @@ namespace detail
 {
 bool resource_is_loaded_no_error(detail::resource_slot const& r);
 bool resource_try_load(detail::resource_slot& r);
-void const* resource_try_get(detail::resource_slot& r);
+void const* resource_try_get(detail::resource_slot& r, base::priority prio);
+int resource_try_get_many(cc::span<detail::resource_slot* const> slots, cc::function_ref<void(size_t, void const*)> on_data, base::priority prio);
 res::base::res_hash resource_get_hash(detail::resource_slot& r);
 
 template <class T>
@@ -24,6 +28,10 @@ detail::resource_slot* resource_from_handle(handle<T> const& h)
 }
 } // namespace detail
 
+/// scheduling priority of requests, see try_get
+/// NOTE: dependencies are computed with the priority of the resource that needs them
+using priority = base::priority;
+
 // TODO: should handle<T> be convertiable in handle<BaseOfT>?
 // TODO: api to inspect errors
 template <class T>
@@ -58,11 +66,16 @@ struct handle
     /// NOTE: will return outdated cached values
     ///      (but recomputation is still triggered)
     /// NOTE: using this on an invalid handle is fine (and returns nullptr)
-    T const* try_get() const
+    /// NOTE: the priority only affects the (re)computation, e.g. priority::high for visible assets
+    ///       and priority::background for prefetching
+    /// CAUTION: the pointer is valid at least until the next collect_garbage, even if the content is replaced in the meantime
+    ///          (afterwards, replaced contents can be evicted)
+    ///          thus, call try_get again instead of keeping the pointer, e.g. once per frame
+    T const* try_get(priority prio = priority::normal) const
     {
         if (!resource)
             return nullptr;
-        auto data = detail::resource_try_get(*resource);
+        auto data = detail::resource_try_get(*resource, prio);
         return static_cast<T const*>(data);
     }
 
@@ -82,6 +95,7 @@ struct handle
     {
         if (this != &rhs)
         {
+            release();
             resource = rhs.resource;
             acquire();
         }
@@ -104,19 +118,21 @@ private:
 
     explicit handle(detail::resource_slot* r) : resource(r) { acquire(); }
 
+    // NOTE: the slot starts with a pointer to the base::ref_count of the resource
     void acquire()
     {
         if (resource)
         {
-            cc::intrin_atomic_add((int volatile*)resource, 1);
+            cc::intrin_atomic_add(*(int volatile**)resource, 1);
         }
     }
     void release()
     {
         if (resource)
         {
-            // TODO: cleanup is performed by system GC
-            cc::intrin_atomic_add((int volatile*)resource, -1);
+            // NOTE: cleanup is performed by System::collect_garbage
+            //       pending computations of unreferenced resources are cancelled
+            cc::intrin_atomic_add(*(int volatile**)resource, -1);
             resource = nullptr;
         }
     }
@@ -126,4 +142,29 @@ private:
     detail::resource_slot* resource = nullptr;
     // TODO: think about caching T* in here
 };
+
+/// batched version of handle::try_get, writes the result for handles[i] to out_data[i]
+/// returns the number of loaded resources
+/// NOTE: much cheaper than calling try_get for each of many handles
+///       (e.g. when all handles are queried each frame)
+/// NOTE: invalid handles are fine (and result in nullptr)
+/// NOTE: the pointers have the same lifetime as the one of handle::try_get (i.e. at least until the next collect_garbage)
+///
+/// Usage:
+///   cc::vector<res::handle<mesh>> meshes = ...;
+///   cc::vector<mesh const*> data;
+///   data.resize(meshes.size());
+///   res::try_get_all<mesh>(meshes, data);
+template <class T>
+int try_get_all(cc::span<handle<T> const> handles, cc::span<T const*> out_data, priority prio = priority::normal)
+{
+    CC_ASSERT(handles.size() == out_data.size() && "one output per handle required");
+
+    // handles are only a slot pointer, so they can be viewed as such
+    static_assert(sizeof(handle<T>) == sizeof(detail::resource_slot*));
+    auto const slots = cc::span<detail::resource_slot* const>(reinterpret_cast<detail::resource_slot* const*>(handles.data()), handles.size());
+
+    return detail::resource_try_get_many(
+        slots, [&](size_t i, void const* data) { out_data[i] = static_cast<T const*>(data); }, prio);
+}
 } // namespace res
@@ -172,11 +172,13 @@ struct resource_traits
             using element_t = cc::collection_element_t<T>;
             res.data_ptr = cc::alloc<T>(data.template reinterpret_as<element_t const>());
             res.deleter = [](void* p) { cc::free(reinterpret_cast<T*>(p)); };
+            res.size_bytes = sizeof(T);
         }
         else if constexpr (std::is_same_v<T, cc::string_view>)
         {
             res.data_ptr = cc::alloc<cc::string_view>(cc::string_view((char const*)data.data(), data.size()));
             res.deleter = [](void* p) { cc::free(reinterpret_cast<cc::string_view*>(p)); };
+            res.size_bytes = sizeof(cc::string_view);
         }
         else if constexpr (std::is_trivially_copyable_v<T>)
         {
@@ -237,6 +239,8 @@ struct resource_traits
             auto& data = res.runtime_data.emplace_back();
             data.data.data_ptr = cc::alloc<T>(cc::move(value));
             data.data.deleter = [](void* p) { cc::free(reinterpret_cast<T*>(p)); };
+            // NOTE: only the direct size, heap allocations of T are unknown
+            data.data.size_bytes = sizeof(T);
         }
     }
 };
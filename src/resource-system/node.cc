@@ -11,11 +11,11 @@
 
 res::base::hash res::detail::make_name_version_algo_hash(cc::string_view name, int version)
 {
-    cc::sha1_builder sha1;
-    sha1.add(cc::as_byte_span(0x6FA2D8E4B7C90A1F));
-    sha1.add(cc::as_byte_span(version));
-    sha1.add(cc::as_byte_span(name));
-    return res::detail::finalize_as<base::hash>(sha1);
+    res::detail::hash_builder builder;
+    builder.add(cc::as_byte_span(0x6FA2D8E4B7C90A1F));
+    builder.add(cc::as_byte_span(version));
+    builder.add(cc::as_byte_span(name));
+    return res::detail::finalize_as<base::hash>(builder);
 }
 
 void res::detail::register_node_name(cc::string_view name)
@@ -34,45 +34,56 @@ template <class Fun>
 class FunctionNode : public Node
 {
 public:
-    FunctionNode(Fun fun, base::hash algo_hash, detail::res_type type) : fun(cc::move(fun)), algo_hash(algo_hash), type(type) {}
+    FunctionNode(Fun fun, base::hash algo_hash, detail::res_type type, base::executor_id executor)
+      : fun(cc::move(fun)), algo_hash(algo_hash), type(type), executor(executor)
+    {
+    }
 
     template <class... Args>
     auto define_resource(Args&&... args)
     {
         // TODO: maybe we need to add arg types to algo_hash as well
         //       because fun might be templated
-        return detail::define_res_via_lambda(algo_hash, type, fun, cc::forward<Args>(args)...);
+        return detail::define_res_via_lambda(algo_hash, type, executor, fun, cc::forward<Args>(args)...);
     }
 
 private:
     Fun fun;
     base::hash algo_hash;
     detail::res_type type;
+    base::executor_id executor;
 };
 
+/// where the function of a node is executed, see base::executor_id
+///   - executor_id::cpu (default): the worker pool
+///   - executor_id::io: a separate pool for blocking work like file reads
+///   - executor_id::main_thread: during System::process_main_thread_jobs (or process_until_idle)
+///   - custom executors via base::ResourceSystem::set_executor
+using executor_id = base::executor_id;
+
 /// helper to wrap a named function into a callable that returns handles given args
 /// NOTE: the name must be _globally_ unique!
 ///       the version should be changed whenever the semantic of the function changes
 template <class FunT>
-auto node(cc::string_view name, int version, FunT&& fun)
+auto node(cc::string_view name, int version, FunT&& fun, executor_id executor = executor_id::cpu)
 {
     detail::register_node_name(name);
-    return FunctionNode<std::decay_t<FunT>>(cc::forward<FunT>(fun), detail::make_name_version_algo_hash(name, version), detail::res_type::normal);
+    return FunctionNode<std::decay_t<FunT>>(cc::forward<FunT>(fun), detail::make_name_version_algo_hash(name, version), detail::res_type::normal, executor);
 }
 
 /// a volatile node has no invocation cache
 /// it is always called if the environment is suspected to have changed
 template <class FunT>
-auto node_volatile(FunT&& fun)
+auto node_volatile(FunT&& fun, executor_id executor = executor_id::cpu)
 {
-    return FunctionNode<std::decay_t<FunT>>(cc::forward<FunT>(fun), base::make_random_unique_hash(), detail::res_type::volatile_);
+    return FunctionNode<std::decay_t<FunT>>(cc::forward<FunT>(fun), base::make_random_unique_hash(), detail::res_type::volatile_, executor);
 }
 /// runtime nodes are not persistent and basically "anonymous"
 /// internally, they are assigned a random comp_hash
 /// they still benefit from all runtime caching and deduplication
 template <class FunT>
-auto node_runtime(FunT&& fun)
+auto node_runtime(FunT&& fun, executor_id executor = executor_id::cpu)
 {
-    return FunctionNode<std::decay_t<FunT>>(cc::forward<FunT>(fun), base::make_random_unique_hash(), detail::res_type::runtime);
+    return FunctionNode<std::decay_t<FunT>>(cc::forward<FunT>(fun), base::make_random_unique_hash(), detail::res_type::runtime, executor);
 }
 } // namespace res
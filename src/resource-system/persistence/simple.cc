@@ -1,14 +1,20 @@
 #include "simple.hh"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 
+#include <clean-core/allocate.hh>
 #include <clean-core/format.hh>
 #include <clean-core/utility.hh>
 
 #include <rich-log/log.hh>
 
 #include <resource-system/System.hh>
+#include <resource-system/detail/hash_helper.hh>
 #include <resource-system/detail/log.hh>
 
 #include <babel-serializer/compression/zstd.hh>
@@ -18,6 +24,22 @@ namespace res
 {
 namespace
 {
+struct format_header
+{
+    uint32_t magic = 0x53505352; // "RSPS"
+    uint32_t version = 1;
+    uint32_t hash_format = res::detail::hash_format_tag;
+    uint32_t reserved = 0;
+};
+
+// hash format of stores written before format.bin existed
+constexpr uint32_t legacy_hash_format = 0x31414853; // "SHA1"
+
+// uncompressed content bytes start at this alignment in the content data files
+// so that they can be used in place (e.g. trivially copyable types point directly into the mapping)
+// NOTE: older files might contain unaligned contents, those are copied when loaded
+constexpr size_t content_data_alignment = 16;
+
 bool append_to_file_or_create(cc::string_view filename, cc::span<std::byte const> data)
 {
     if (data.empty())
@@ -27,16 +49,29 @@ bool append_to_file_or_create(cc::string_view filename, cc::span<std::byte const
     auto file = std::ofstream(path, std::ios::binary | std::ios::app);
     if (!file.is_open())
     {
-        std::filesystem::create_directories(path.parent_path());
+        std::error_code ec;
+        std::filesystem::create_directories(path.parent_path(), ec);
         LOG("creating '%s'", filename);
-        babel::file::write(filename, data);
-        return true;
+        file = std::ofstream(path, std::ios::binary | std::ios::app);
+        if (!file.is_open())
+        {
+            LOG_ERROR("could not open '%s'", filename);
+            return false;
+        }
     }
 
     file.write((char const*)data.data(), data.size());
     file.close();
+    if (!file.good())
+    {
+        LOG_ERROR("could not write to '%s'", filename);
+        return false;
+    }
     return true;
 }
+
+// the delta segment of the index at index_filename (see SimplePersistentStore::mapped_index)
+cc::string delta_index_filename(cc::string const& index_filename) { return index_filename + ".delta"; }
 } // namespace
 } // namespace res
 
@@ -45,13 +80,315 @@ struct res::persistence::SimplePersistentStore::content_data
     explicit content_data(cc::string_view path) { data = babel::file::make_memory_mapped_file_readonly(path); }
 
     babel::file::memory_mapped_file<std::byte const> data;
+
+    // one reference is held by the store, one by each content that points into data
+    std::atomic<int> ref_count = 1;
+
+    void acquire() { ref_count.fetch_add(1); }
+    static void release(void* p)
+    {
+        auto const d = static_cast<content_data*>(p);
+        if (d->ref_count.fetch_sub(1) == 1)
+            cc::free(d);
+    }
+};
+
+// on-disk index of one of the logs (invocs.bin or contents.bin)
+// consists of a main segment and a delta segment (see delta_index_filename) for the entries appended since the main one was built
+// segment layout: header, bloom filter, entries sorted by key (w0, then w1)
+// segments are queried in place via their memory mapping, so opening them is O(1)
+// NOTE: the delta is only merged into the main segment once it is large enough (see should_merge)
+//       so updating the index after a write is proportional to the delta and not to the whole log
+template <class ValueT>
+struct res::persistence::SimplePersistentStore::mapped_index
+{
+    using entry = cc::pair<base::hash, ValueT>;
+    static_assert(sizeof(entry) % alignof(base::hash) == 0);
+
+    struct header
+    {
+        uint32_t magic = 0x58495352; // "RSIX"
+        uint32_t version = 2;
+        uint64_t entry_count = 0;
+        uint64_t bloom_words = 0;  // power of two
+        uint64_t source_begin = 0; // the covered range of the log, i.e. [source_begin, source_size)
+        uint64_t source_size = 0;  // size of the log when the segment was built
+        uint64_t reserved = 0;
+    };
+    static_assert(sizeof(header) % alignof(base::hash) == 0);
+
+    // the bloom filter must keep the entries aligned
+    static constexpr uint64_t min_bloom_words = alignof(base::hash) < sizeof(uint64_t) ? 1 : alignof(base::hash) / sizeof(uint64_t);
+
+    // ~1% false positives
+    static constexpr int bloom_bits_per_entry = 10;
+    static constexpr int bloom_probes = 7;
+
+    // deltas up to this size are never merged (a new main segment is written for every eighth of its size otherwise)
+    static constexpr size_t min_merge_entries = 4096;
+
+    static bool should_merge(size_t delta_entries, size_t main_entries) { return delta_entries > cc::max(min_merge_entries, main_entries / 8); }
+
+    struct segment
+    {
+        babel::file::memory_mapped_file<std::byte const> file;
+        uint64_t source_begin = 0;
+        uint64_t source_size = 0;
+        cc::span<uint64_t const> bloom;
+        cc::span<entry const> entries;
+
+        // returns nullptr if the file does not exist or is not a valid segment
+        static cc::unique_ptr<segment> open(cc::string_view filename)
+        {
+            if (!babel::file::exists(filename))
+                return nullptr;
+
+            auto seg = cc::make_unique<segment>();
+            seg->file = babel::file::make_memory_mapped_file_readonly(filename);
+            auto const data = cc::span<std::byte const>(seg->file.data(), seg->file.size());
+
+            header const expected;
+            header h;
+            if (data.size() < sizeof(header))
+                return nullptr;
+            std::memcpy(&h, data.data(), sizeof(header));
+            if (h.magic != expected.magic || h.version != expected.version || h.bloom_words < min_bloom_words || (h.bloom_words & (h.bloom_words - 1)) != 0
+                || h.source_begin > h.source_size || data.size() != sizeof(header) + h.bloom_words * sizeof(uint64_t) + h.entry_count * sizeof(entry))
+                return nullptr;
+
+            seg->source_begin = h.source_begin;
+            seg->source_size = h.source_size;
+            seg->bloom = data.subspan(sizeof(header), h.bloom_words * sizeof(uint64_t)).template reinterpret_as<uint64_t const>();
+            seg->entries = data.subspan(sizeof(header) + h.bloom_words * sizeof(uint64_t)).template reinterpret_as<entry const>();
+            return seg;
+        }
+
+        ValueT const* find(base::hash const& key) const
+        {
+            auto maybe_contained = true;
+            for_each_bloom_bit(key, bloom.size(), [&](size_t bit) { maybe_contained &= ((bloom[bit >> 6] >> (bit & 63)) & 1) != 0; });
+            if (!maybe_contained)
+                return nullptr;
+
+            auto const it = std::lower_bound(entries.begin(), entries.end(), key, [](entry const& e, base::hash const& k) { return is_less(e.first, k); });
+            if (it == entries.end() || it->first != key)
+                return nullptr;
+            return &it->second;
+        }
+    };
+
+    cc::unique_ptr<segment> main;
+    cc::unique_ptr<segment> delta; // nullptr if the main segment covers the whole log
+
+    // entries in the delta replace the ones in the main segment
+    ValueT const* find(base::hash const& key) const
+    {
+        if (delta != nullptr)
+            if (auto const value = delta->find(key))
+                return value;
+        return main->find(key);
+    }
+
+    // NOTE: counts keys that are in both segments twice
+    size_t entry_count() const { return main->entries.size() + (delta != nullptr ? delta->entries.size() : 0); }
+
+    // returns nullptr if the segments do not exist or do not cover exactly log_size bytes of the log
+    static cc::unique_ptr<mapped_index> open(cc::string const& filename, uint64_t log_size)
+    {
+        auto idx = cc::make_unique<mapped_index>();
+        idx->main = segment::open(filename);
+        if (idx->main == nullptr || idx->main->source_begin != 0)
+            return nullptr;
+        if (idx->main->source_size == log_size)
+            return idx;
+
+        idx->delta = segment::open(delta_index_filename(filename));
+        if (idx->delta == nullptr || idx->delta->source_begin != idx->main->source_size || idx->delta->source_size != log_size)
+            return nullptr;
+        return idx;
+    }
+
+    // the bloom filter uses the hash bits directly (they are uniformly distributed)
+    // NOTE: the step is odd and the size a power of two, so all probes hit different bits
+    template <class F>
+    static void for_each_bloom_bit(base::hash const& key, size_t bloom_words, F&& f)
+    {
+        auto const mask = bloom_words * 64 - 1;
+        auto bit = key.w0;
+        auto const step = key.w1 | 1;
+        for (auto i = 0; i < bloom_probes; ++i, bit += step)
+            f(size_t(bit & mask));
+    }
+
+    static bool is_less(base::hash const& a, base::hash const& b) { return a.w0 < b.w0 || (a.w0 == b.w0 && a.w1 < b.w1); }
+
+    // removes all but the first entry of each key from sorted entries
+    static void remove_duplicates(cc::vector<entry>& entries)
+    {
+        auto const end = std::unique(entries.begin(), entries.end(), [](entry const& a, entry const& b) { return a.first == b.first; });
+        entries.resize(end - entries.begin());
+    }
+
+    // sorts by key, keeps the last entry of each key (the log is append-only, so later entries replace earlier ones)
+    static void sort_unique(cc::vector<entry>& entries)
+    {
+        std::reverse(entries.begin(), entries.end());
+        std::stable_sort(entries.begin(), entries.end(), [](entry const& a, entry const& b) { return is_less(a.first, b.first); });
+        remove_duplicates(entries);
+    }
+
+    // merges sorted unique entries, the newer ones replace older ones with the same key
+    // NOTE: std::merge takes equal keys from the first range first
+    static cc::vector<entry> merge(cc::span<entry const> newer, cc::span<entry const> older)
+    {
+        cc::vector<entry> merged;
+        merged.resize(newer.size() + older.size());
+        auto const end = std::merge(newer.begin(), newer.end(), older.begin(), older.end(), merged.begin(),
+                                    [](entry const& a, entry const& b) { return is_less(a.first, b.first); });
+        merged.resize(end - merged.begin());
+        remove_duplicates(merged);
+        return merged;
+    }
+
+    // writes a segment covering [source_begin, source_size) of the log
+    // NOTE: written to a temporary file first, so readers never see a partial segment
+    static bool write_segment(cc::string const& filename, cc::span<entry const> entries, uint64_t source_begin, uint64_t source_size)
+    {
+        header h;
+        h.entry_count = entries.size();
+        h.bloom_words = min_bloom_words;
+        while (h.bloom_words * 64 < entries.size() * bloom_bits_per_entry)
+            h.bloom_words *= 2;
+        h.source_begin = source_begin;
+        h.source_size = source_size;
+
+        cc::vector<uint64_t> bloom;
+        bloom.resize(h.bloom_words);
+        for (auto& w : bloom)
+            w = 0;
+        for (auto const& e : entries)
+            for_each_bloom_bit(e.first, bloom.size(), [&](size_t bit) { bloom[bit >> 6] |= uint64_t(1) << (bit & 63); });
+
+        auto const tmp_filename = filename + ".tmp";
+        {
+            auto file = std::ofstream(std::filesystem::path(tmp_filename.c_str()), std::ios::binary | std::ios::trunc);
+            if (!file.is_open())
+                return false;
+            file.write((char const*)&h, sizeof(h));
+            file.write((char const*)bloom.data(), bloom.size() * sizeof(uint64_t));
+            file.write((char const*)entries.data(), entries.size() * sizeof(entry));
+            if (!file.good())
+                return false;
+        }
+
+        std::error_code ec;
+        std::filesystem::rename(std::filesystem::path(tmp_filename.c_str()), std::filesystem::path(filename.c_str()), ec);
+        if (ec)
+        {
+            // e.g. on Windows, where files that are still mapped cannot be replaced
+            std::filesystem::remove(std::filesystem::path(tmp_filename.c_str()), ec);
+            return false;
+        }
+        return true;
+    }
+
+    // makes the index at filename cover the whole log
+    // only the part of the log that is not covered yet is sorted, then merged into the delta
+    // the main segment is only rewritten if the delta becomes too large
+    template <class KeyT>
+    static bool update(cc::string const& filename, cc::string const& log_filename)
+    {
+        if (!babel::file::exists(log_filename))
+            return true; // nothing persisted yet
+
+        auto const log_size = babel::file::size_of(log_filename);
+        auto const belongs_to_log = [&](cc::unique_ptr<segment> const& s, uint64_t begin)
+        { return s->source_begin == begin && s->source_size <= log_size && s->source_size % sizeof(cc::pair<KeyT, ValueT>) == 0; };
+
+        auto main = segment::open(filename);
+        if (main != nullptr && !belongs_to_log(main, 0))
+            main = nullptr;
+        if (main != nullptr && main->source_size == log_size)
+            return true; // up to date
+
+        auto delta = main != nullptr ? segment::open(delta_index_filename(filename)) : nullptr;
+        if (delta != nullptr && !belongs_to_log(delta, main->source_size))
+            delta = nullptr; // e.g. left over from before the last merge
+        if (delta != nullptr && delta->source_size == log_size)
+            return true; // up to date
+
+        auto const covered = delta != nullptr ? delta->source_size : main != nullptr ? main->source_size : 0;
+        auto const log = babel::file::make_memory_mapped_file_readonly(log_filename);
+        auto const tail = cc::span<std::byte const>(log.data(), log_size).subspan(covered).template reinterpret_as<cc::pair<KeyT, ValueT> const>();
+
+        cc::vector<entry> added;
+        added.reserve(tail.size());
+        for (auto const& [key, value] : tail)
+            added.emplace_back(key, value);
+        sort_unique(added);
+
+        if (delta != nullptr)
+            added = merge(added, delta->entries);
+        delta = nullptr; // unmap before replacing the file
+
+        if (main != nullptr && !should_merge(added.size(), main->entries.size()))
+            return write_segment(delta_index_filename(filename), added, main->source_size, log_size);
+
+        auto const merged = main != nullptr ? merge(added, main->entries) : cc::move(added);
+        main = nullptr; // unmap before replacing the file
+        if (!write_segment(filename, merged, 0, log_size))
+            return false;
+
+        // the old delta is covered by the main segment now (and would be ignored otherwise)
+        std::error_code ec;
+        std::filesystem::remove(std::filesystem::path(delta_index_filename(filename).c_str()), ec);
+        return true;
+    }
+
+    // opens the index, updates it first if it does not cover the whole log
+    template <class KeyT>
+    static cc::unique_ptr<mapped_index> open_or_update(cc::string const& filename, cc::string const& log_filename)
+    {
+        auto const log_size = babel::file::size_of(log_filename);
+        if (auto idx = open(filename, log_size))
+            return idx;
+
+        LOG("updating index '%s'", filename);
+        if (!update<KeyT>(filename, log_filename))
+            return nullptr;
+        return open(filename, log_size);
+    }
+};
+
+// the mapped invoc index as read-only layer below the invoc store
+struct res::persistence::SimplePersistentStore::invoc_index final : base::invoc_layer
+{
+    cc::unique_ptr<mapped_index<base::content_hash>> index;
+
+    cc::optional<base::content_hash> find(base::invoc_hash invoc) const override
+    {
+        if (auto content = index->find(invoc))
+            return *content;
+        return cc::nullopt;
+    }
 };
 
 res::persistence::SimplePersistentStore::SimplePersistentStore(cc::string base_dir, simple_persistence_config cfg) : _config(cfg), _base_dir(base_dir)
 {
 }
 
-res::persistence::SimplePersistentStore::~SimplePersistentStore() = default;
+res::persistence::SimplePersistentStore::~SimplePersistentStore()
+{
+    stop_writer();
+
+    // NOTE: waits for running lookups, so the indices and mappings can be released afterwards
+    if (_content_provider.has_value())
+        res::system().base().remove_content_provider(_content_provider.value());
+    if (_is_invoc_layer)
+        res::system().base().remove_invoc_layer(_invoc_index.get());
+
+    close_open_data();
+}
 
 bool res::persistence::SimplePersistentStore::load()
 {
@@ -59,9 +396,13 @@ bool res::persistence::SimplePersistentStore::load()
     CC_ASSERT(!_is_loaded && "cannot load twice for now");
     _is_loaded = true;
 
-    _cached_invocs.clear();
-    _content.clear();
-    _data.clear();
+    // NOTE: the first write waits for _mutex, i.e. until loading is done
+    if (_config.write_behind)
+        _writer = std::thread([this] { writer_loop(); });
+
+    _invoc_index = nullptr;
+    _content_index = nullptr;
+    close_open_data();
 
     auto const invoc_file = invoc_filename();
     auto const content_file = content_filename();
@@ -72,68 +413,143 @@ bool res::persistence::SimplePersistentStore::load()
         return false;
     }
 
-    // register as fallback provider
-    res::system().base().inject_content_provider([this](base::content_hash hash) { return this->try_get_content(hash); });
-
-    // read and add invocation cache data
-    auto invoc_data = babel::file::make_memory_mapped_file_readonly(invoc_file);
-    auto invocs = cc::span(invoc_data).reinterpret_as<cc::pair<base::invoc_hash, base::content_hash> const>();
-    res::system().base().inject_invoc_cache(invocs);
-    for (auto const& [invoc, content] : invocs)
-        _cached_invocs.add(invoc);
-
-    // read and add content cache data
-    auto content_data = babel::file::make_memory_mapped_file_readonly(content_file);
-    auto contents = cc::span(content_data).reinterpret_as<cc::pair<base::content_hash, content_info> const>();
-    uint64_t max_file = 0;
-    for (auto [content, info] : contents)
+    if (!is_compatible_format())
     {
-        _content[content] = info;
-        max_file = cc::max(max_file, info.file);
+        LOG_WARN("persistency data in '%s' uses a different hash format and is discarded", _base_dir);
+        discard_files();
+        return false;
     }
-    if (max_file > 200)
+
+    // map the indices (usually without reading them, only outdated ones are updated)
+    // NOTE: the indices are immutable afterwards, so they can be queried without locking
+    _content_index = mapped_index<content_info>::open_or_update<base::content_hash>(content_index_filename(), content_file);
+    auto invoc_idx = mapped_index<base::content_hash>::open_or_update<base::invoc_hash>(invoc_index_filename(), invoc_file);
+    if (_content_index == nullptr || invoc_idx == nullptr)
     {
-        LOG_ERROR("too many content files referenced in '%s'. indicating corruption", content_file);
+        LOG_ERROR("could not open persistency index in '%s'", _base_dir);
+        _content_index = nullptr;
         return false;
     }
+    _invoc_index = cc::make_unique<invoc_index>();
+    _invoc_index->index = cc::move(invoc_idx);
+
+    // register as content provider and invoc layer
+    // NOTE: only after the indices are complete, both are queried concurrently from then on
+    _content_provider = res::system().base().inject_content_provider([this](base::content_hash hash) { return this->try_get_content(hash); });
+    res::system().base().add_invoc_layer(_invoc_index.get());
+    _is_invoc_layer = true;
 
     // accumulate file sizes
     size_t content_data_size = 0;
-    for (auto i = 0u; i <= max_file; ++i)
-    {
-        auto filename = content_data_filename(i);
-        if (babel::file::exists(filename))
-            content_data_size += babel::file::size_of(filename);
-    }
+    for (auto i = 0; babel::file::exists(content_data_filename(i)); ++i)
+        content_data_size += babel::file::size_of(content_data_filename(i));
 
-    LOG("using persistency cache (%s invocs, %s contents, %.2f MB)", invocs.size(), contents.size(), content_data_size / 1024. / 1024.);
+    LOG("using persistency cache (%s invocs, %s contents, %.2f MB)", _invoc_index->index->entry_count(), _content_index->entry_count(),
+        content_data_size / 1024. / 1024.);
     return true;
 }
 
 bool res::persistence::SimplePersistentStore::save()
 {
-    auto lock = std::unique_lock(_mutex);
+    if (!_writer.joinable())
+        return flush();
+
+    {
+        auto lock = std::lock_guard{_writer_mutex};
+        ++_write_rounds_requested;
+    }
+    _writer_cv.notify_all();
+    return true;
+}
 
-    // close open mmapped files
-    _data.clear();
+bool res::persistence::SimplePersistentStore::flush()
+{
+    if (!_writer.joinable())
+    {
+        auto lock = std::unique_lock(_mutex);
+        return write_new_data();
+    }
+
+    // a round that already started might miss data computed before this call, so we wait for the next one
+    auto lock = std::unique_lock(_writer_mutex);
+    auto const round = ++_write_rounds_requested;
+    _writer_cv.notify_all();
+    _writer_cv.wait(lock, [&] { return _write_rounds_finished >= round; });
+    return _last_write_ok;
+}
+
+void res::persistence::SimplePersistentStore::writer_loop()
+{
+    auto lock = std::unique_lock(_writer_mutex);
+    while (true)
+    {
+        // periodic writes are not requested but still performed
+        _writer_cv.wait_for(lock, std::chrono::milliseconds(_config.write_behind_interval_ms),
+                            [&] { return _stop_writer || _write_rounds_requested > _write_rounds_finished; });
+        if (_stop_writer && _write_rounds_requested == _write_rounds_finished)
+            break;
+
+        auto const round = _write_rounds_requested;
+        lock.unlock();
+        bool ok;
+        {
+            auto data_lock = std::unique_lock(_mutex);
+            ok = write_new_data();
+        }
+        lock.lock();
+
+        _write_rounds_finished = round;
+        _last_write_ok = ok;
+        _writer_cv.notify_all();
+    }
+}
+
+void res::persistence::SimplePersistentStore::stop_writer()
+{
+    if (!_writer.joinable())
+        return;
+
+    // the last round writes everything that is still pending
+    {
+        auto lock = std::lock_guard{_writer_mutex};
+        ++_write_rounds_requested;
+        _stop_writer = true;
+    }
+    _writer_cv.notify_all();
+    _writer.join();
+}
+
+bool res::persistence::SimplePersistentStore::write_new_data()
+{
+    // NOTE: open mmapped files stay open, concurrent try_get_content might use them
+    //       the contents written here are appended (beyond the mapped range) and not part of the index
+
+    if (!write_format_if_missing())
+        return false;
 
     // TODO: GC + limits
 
-    // save invocs
-    auto new_invocs = res::system().base().collect_all_persistent_invocations(_cached_invocs);
-    append_to_file_or_create(invoc_filename(), cc::as_byte_span(new_invocs));
-    // LOG("written %s new cached invocs to '%s'", new_invocs.size(), invoc_filename());
+    // NOTE: only invocs computed since the last write are returned, so this is proportional to the new data
+    auto new_invocs = res::system().base().drain_new_persistent_invocations();
+    using invoc_span = cc::span<cc::pair<base::invoc_hash, base::content_hash> const>;
+
+    // invocs that are not written are put back, so that the next write retries them
+    auto const requeue = [](invoc_span invocs)
+    {
+        if (!invocs.empty())
+            res::system().base().requeue_persistent_invocations(invocs);
+    };
+
+    auto const is_content_persisted = [&](base::content_hash content)
+    { return (_content_index != nullptr && _content_index->find(content) != nullptr) || _written_contents.contains(content); };
 
     // compute new content
+    // NOTE: many invocs can have the same content
+    cc::set<base::content_hash> queried_contents;
     cc::vector<base::content_hash> content_to_query;
     for (auto const& [invoc, content] : new_invocs)
-    {
-        if (_content.contains_key(content))
-            continue; // already cached
-
-        content_to_query.push_back(content);
-    }
-    auto content_res = res::system().base().collect_all_persistent_content(content_to_query);
+        if (!is_content_persisted(content) && queried_contents.add(content))
+            content_to_query.push_back(content);
 
     // write data and collect contents update
     cc::vector<cc::pair<base::content_hash, content_info>> new_contents;
@@ -148,7 +564,8 @@ bool res::persistence::SimplePersistentStore::save()
             auto path = std::filesystem::path(cc::string(filename).c_str());
             if (!babel::file::exists(filename))
             {
-                std::filesystem::create_directories(path.parent_path());
+                std::error_code ec;
+                std::filesystem::create_directories(path.parent_path(), ec);
                 LOG("creating '%s'", filename);
             }
             else
@@ -161,13 +578,17 @@ bool res::persistence::SimplePersistentStore::save()
             }
 
             file = std::ofstream(path, std::ios::binary | std::ios::app);
-            CC_ASSERT(file.is_open());
+            if (!file.is_open())
+            {
+                LOG_ERROR("could not open '%s'", filename);
+                bytes_left = 0;
+            }
         }
 
-        // returns nullif not enough space
+        // returns nullopt if not enough space or on error (see is_ok)
         cc::optional<content_info> write(base::content_ref const& content)
         {
-            if (bytes_left == 0)
+            if (bytes_left == 0 || !file.good())
                 return cc::nullopt;
 
             content_info info;
@@ -187,6 +608,12 @@ bool res::persistence::SimplePersistentStore::save()
             {
                 CC_ASSERT(content.has_serialized_data());
 
+                // pad so that the bytes after the type tag are aligned (the padding is not part of any content)
+                auto const padding = (content_data_alignment - (size_t(info.offset) + 1) % content_data_alignment) % content_data_alignment;
+                char const zeros[content_data_alignment] = {};
+                file.write(zeros, padding);
+                info.offset += padding;
+
                 char const type = 'V';
                 file.write(&type, 1);
 
@@ -227,66 +654,133 @@ bool res::persistence::SimplePersistentStore::save()
                 write_error();
             }
 
+            if (!file.good())
+                return cc::nullopt;
+
             info.size = int64_t(file.tellp()) - info.offset;
             bytes_left -= info.size;
             return info;
         }
 
+        bool is_ok() const { return file.is_open() && file.good(); }
+
         int idx;
         std::ofstream file;
         size_t bytes_left;
     };
     cc::vector<file_writer> writers;
-    for (auto const& content : content_res)
+    // NOTE: collected contents are kept alive until written, so this is done in batches
+    auto const batch_count = size_t(cc::max(1, _config.max_write_batch_count));
+    for (size_t batch_start = 0; batch_start < content_to_query.size(); batch_start += batch_count)
     {
-        auto needs_new = true;
+        auto const batch = cc::span<base::content_hash const>(content_to_query)
+                               .subspan(batch_start, cc::min(batch_count, content_to_query.size() - batch_start));
+        for (auto const& content : res::system().base().collect_all_persistent_content(batch))
+        {
+            auto needs_new = true;
+
+            for (auto& writer : writers)
+                if (auto info = writer.write(content); info.has_value())
+                {
+                    needs_new = false;
+                    new_contents.emplace_back(content.hash, info.value());
+                    break;
+                }
 
-        for (auto& writer : writers)
-            if (auto info = writer.write(content); info.has_value())
+            if (needs_new)
             {
-                needs_new = false;
-                new_contents.emplace_back(content.hash, info.value());
-                break;
+                auto fidx = int(writers.size());
+                writers.emplace_back(fidx, content_data_filename(fidx), _config.max_content_file_size);
+                auto info = writers.back().write(content);
+                if (info.has_value())
+                {
+                    new_contents.emplace_back(content.hash, info.value());
+                }
+                else
+                    LOG_WARN("could not write content to '%s'", content_data_filename(fidx));
             }
+        }
+    }
 
-        if (needs_new)
+    // contents are only referenced once their data is on disk
+    auto ok = true;
+    for (auto& writer : writers)
+    {
+        writer.file.flush();
+        if (!writer.is_ok())
         {
-            auto fidx = int(writers.size());
-            writers.emplace_back(fidx, content_data_filename(fidx), _config.max_content_file_size);
-            auto info = writers.back().write(content);
-            if (info.has_value())
-            {
-                new_contents.emplace_back(content.hash, info.value());
-            }
-            else
-                LOG_WARN("could not write content to '%s'", content_data_filename(fidx));
+            LOG_ERROR("could not write to '%s'", content_data_filename(writer.idx));
+            ok = false;
         }
     }
+    if (!ok)
+    {
+        requeue(new_invocs);
+        return false;
+    }
 
     size_t new_content_total_size = 0;
     for (auto&& [content, info] : new_contents)
         new_content_total_size += info.size;
 
     // save contents
-    append_to_file_or_create(content_filename(), cc::as_byte_span(new_contents));
+    if (!append_to_file_or_create(content_filename(), cc::as_byte_span(new_contents)))
+    {
+        requeue(new_invocs);
+        return false;
+    }
+    for (auto&& [content, info] : new_contents)
+        _written_contents.add(content);
+
+    // save invocs, but only those with persisted content
+    // NOTE: the others (e.g. whose content was evicted before this write) are retried by the next write
+    //       the order of the log is kept, later entries of the same invoc replace earlier ones
+    auto const skipped_begin = std::stable_partition(new_invocs.begin(), new_invocs.end(), [&](auto const& e) { return is_content_persisted(e.second); });
+    auto const persisted_invoc_count = size_t(skipped_begin - new_invocs.begin());
+    if (!append_to_file_or_create(invoc_filename(), cc::as_byte_span(invoc_span(new_invocs).subspan(0, persisted_invoc_count))))
+    {
+        requeue(new_invocs);
+        return false;
+    }
+    if (persisted_invoc_count < new_invocs.size())
+    {
+        LOG("postponed %s invocs without persisted content", new_invocs.size() - persisted_invoc_count);
+        requeue(invoc_span(new_invocs).subspan(persisted_invoc_count));
+    }
+    new_invocs.resize(persisted_invoc_count);
+
+    // make the indices cover the new entries
+    // NOTE: the indices used by this store stay unchanged (they might be used concurrently)
+    //       an outdated index is rebuilt by the next load, so failing here loses no data and does not fail the write
+    //       (e.g. on Windows, the index files mapped by this store cannot be replaced)
+    if (!mapped_index<content_info>::update<base::content_hash>(content_index_filename(), content_filename()))
+        LOG_WARN("could not update '%s', it is rebuilt on next load", content_index_filename());
+    if (!mapped_index<base::content_hash>::update<base::invoc_hash>(invoc_index_filename(), invoc_filename()))
+        LOG_WARN("could not update '%s', it is rebuilt on next load", invoc_index_filename());
     // LOG("written %s new cached contents to '%s' (%.2f MB)", new_contents.size(), content_filename(), new_content_total_size / 1024. / 1024.);
 
     if (!new_invocs.empty() || !new_contents.empty())
         LOG("updated persistency cache (+%s invocs, +%s contents, +%.2f MB)", new_invocs.size(), new_contents.size(), new_content_total_size / 1024. / 1024.);
 
-    return true;
+    return ok;
 }
 
 cc::optional<res::base::computation_result> res::persistence::SimplePersistentStore::try_get_content(base::content_hash hash)
 {
-    // TODO: less locking?
-    auto lock = std::unique_lock(_mutex);
+    // NOTE: no locking, the index is immutable after load and data files are opened lock-free
+    //       thus, decompression runs in parallel on all calling threads
 
     // look up info
-    auto p_info = _content.get_ptr(hash);
+    auto p_info = _content_index != nullptr ? _content_index->find(hash) : nullptr;
     if (!p_info)
         return cc::nullopt; // not found
 
+    if (p_info->file >= max_content_files)
+    {
+        LOG_ERROR("content in '%s' references content file %s. indicating corruption", _base_dir, p_info->file);
+        return cc::nullopt;
+    }
+
     return this->get_content_from_info(*p_info);
 }
 
@@ -295,9 +789,9 @@ res::base::computation_result res::persistence::SimplePersistentStore::get_conte
     CC_ASSERT(info.size >= 1);
 
     // ensure file is mmapped
-    this->ensure_open_data(info.file);
+    auto const file = this->ensure_open_data(info.file);
 
-    auto raw_data = cc::span(_data[info.file]->data).subspan(info.offset, info.size);
+    auto raw_data = cc::span(file->data).subspan(info.offset, info.size);
     auto type = char(raw_data[0]);
 
     switch (type)
@@ -305,9 +799,19 @@ res::base::computation_result res::persistence::SimplePersistentStore::get_conte
     case 'V':
     {
         res::base::computation_result res;
-        res::base::content_serialized_data data;
-        data.blob = cc::vector<std::byte>(raw_data.subspan(1));
-        res.serialized_data = cc::move(data);
+        auto const bytes = raw_data.subspan(1);
+        if (cc::is_aligned(bytes.data(), content_data_alignment))
+        {
+            // zero-copy: points directly into the mapping, which is kept alive by the content
+            file->acquire();
+            res.serialized_data = res::base::content_serialized_data::make_external(bytes, file, &content_data::release);
+        }
+        else
+        {
+            res::base::content_serialized_data data;
+            data.blob = cc::vector<std::byte>(bytes);
+            res.serialized_data = cc::move(data);
+        }
         return res;
     }
     case 'v':
@@ -332,26 +836,99 @@ res::base::computation_result res::persistence::SimplePersistentStore::get_conte
     return {};
 }
 
+cc::string res::persistence::SimplePersistentStore::format_filename() const { return _base_dir + "/format.bin"; }
+
 cc::string res::persistence::SimplePersistentStore::invoc_filename() const { return _base_dir + "/invocs.bin"; }
 
 cc::string res::persistence::SimplePersistentStore::content_filename() const { return _base_dir + "/contents.bin"; }
 
+cc::string res::persistence::SimplePersistentStore::invoc_index_filename() const { return _base_dir + "/invocs.idx"; }
+
+cc::string res::persistence::SimplePersistentStore::content_index_filename() const { return _base_dir + "/contents.idx"; }
+
 cc::string res::persistence::SimplePersistentStore::content_data_filename(int file) const
 {
     return cc::format("%s/content_data_%s.bin", _base_dir, file);
 }
 
-void res::persistence::SimplePersistentStore::close_open_data() { _data.clear(); }
+bool res::persistence::SimplePersistentStore::is_compatible_format() const
+{
+    auto const filename = format_filename();
+    if (!babel::file::exists(filename))
+        return legacy_hash_format == res::detail::hash_format_tag;
+
+    auto const data = babel::file::read_all_bytes(filename);
+    format_header const expected;
+    format_header header;
+    if (data.size() != sizeof(header))
+        return false;
+    std::memcpy(&header, data.data(), sizeof(header));
+
+    return header.magic == expected.magic && header.version == expected.version && header.hash_format == expected.hash_format;
+}
+
+bool res::persistence::SimplePersistentStore::write_format_if_missing()
+{
+    auto const filename = format_filename();
+    if (babel::file::exists(filename))
+        return true;
+
+    // NOTE: a store without format.bin but with data is a compatible legacy store (otherwise load would have discarded it)
+    format_header const header;
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(_base_dir.c_str()), ec);
+    if (!append_to_file_or_create(filename, cc::as_byte_span(header)))
+    {
+        LOG_ERROR("could not write '%s'", filename);
+        return false;
+    }
+    return true;
+}
 
-void res::persistence::SimplePersistentStore::ensure_open_data(uint32_t file)
+void res::persistence::SimplePersistentStore::discard_files()
 {
-    // make place for slots
-    while (file >= _data.size())
-        _data.push_back(nullptr);
+    auto remove_file = [](cc::string const& filename)
+    {
+        std::error_code ec;
+        std::filesystem::remove(std::filesystem::path(filename.c_str()), ec);
+        if (ec)
+            LOG_WARN("could not remove '%s'", filename);
+    };
+
+    remove_file(format_filename());
+    remove_file(invoc_filename());
+    remove_file(content_filename());
+    remove_file(invoc_index_filename());
+    remove_file(content_index_filename());
+    remove_file(delta_index_filename(invoc_index_filename()));
+    remove_file(delta_index_filename(content_index_filename()));
+    for (auto i = 0; babel::file::exists(content_data_filename(i)); ++i)
+        remove_file(content_data_filename(i));
+}
+
+void res::persistence::SimplePersistentStore::close_open_data()
+{
+    for (auto& slot : _data)
+        if (auto d = slot.exchange(nullptr))
+            content_data::release(d);
+}
+
+res::persistence::SimplePersistentStore::content_data* res::persistence::SimplePersistentStore::ensure_open_data(uint32_t file)
+{
+    CC_ASSERT(file < max_content_files);
+    auto& slot = _data[file];
 
     // already open?
-    if (_data[file] != nullptr)
-        return;
+    if (auto d = slot.load(std::memory_order_acquire))
+        return d;
 
-    _data[file] = cc::make_unique<content_data>(content_data_filename(file));
+    // racing threads might open the same file, only one mapping is published
+    auto d = cc::alloc<content_data>(content_data_filename(file));
+    content_data* expected = nullptr;
+    if (!slot.compare_exchange_strong(expected, d, std::memory_order_acq_rel))
+    {
+        content_data::release(d);
+        return expected;
+    }
+    return d;
 }
@@ -1,16 +1,19 @@
 #pragma once
 
-#include <clean-core/map.hh>
-#include <clean-core/set.hh>
 #include <clean-core/string.hh>
 #include <clean-core/optional.hh>
+#include <clean-core/set.hh>
 #include <clean-core/unique_ptr.hh>
 #include <clean-core/vector.hh>
 
+#include <atomic>
+#include <condition_variable>
 #include <mutex>
+#include <thread>
 
 #include <resource-system/base/hash.hh>
 #include <resource-system/base/comp_result.hh>
+#include <resource-system/base/api.hh>
 
 // simple resource persistence layer for now
 // we have to persist two stores:
@@ -29,6 +32,14 @@ struct simple_persistence_config
     size_t max_content_size = 20uLL << 30;     // 20 GB
     size_t max_content_file_size = 1uLL << 30; // 1 GB
     size_t max_invoc_count = 1 << 20;          // 1 mio
+
+    // if true, save() does not block: new data is compressed and appended by a background thread
+    // the thread is started by load() and also writes periodically
+    // NOTE: see SimplePersistentStore for the lifetime rule (the destructor writes pending data)
+    bool write_behind = false;
+    int write_behind_interval_ms = 2000;
+    // number of contents collected (and thus kept alive) at once while writing
+    int max_write_batch_count = 256;
 };
 
 /// very simple file-based persistent
@@ -38,9 +49,27 @@ struct simple_persistence_config
 ///
 /// file layout
 /// base_dir/
+///   format.bin (magic, version, hash format tag)
 ///   invocs.bin (span of invoc hash -> content hash)
 ///   contents.bin (span of content hash -> content desc)
+///   invocs.idx, contents.idx (header, bloom filter, entries sorted by hash)
+///   invocs.idx.delta, contents.idx.delta (same, for the log entries appended since the .idx was built)
 ///   content_data_<i>.bin (span of bytes)
+///
+/// invocs.bin and contents.bin are append-only logs
+/// the .idx files are sorted copies of them that are memory mapped and queried in place
+/// thus, load does not depend on the number of entries
+/// save only rewrites the small delta, which is merged into the .idx once it exceeds an eighth of it
+/// (a missing or outdated index, e.g. after a crash during save, is rebuilt from the log)
+///
+/// uncompressed contents are served directly from the memory mapped content data files (no copy)
+/// the mapping stays alive as long as any such content does
+///
+/// with write_behind, writing happens on a background thread and never blocks readers
+/// flush() (or the destructor) waits until everything computed so far is written
+///
+/// lifetime: the store must be destroyed before the resource system (e.g. a local or member, not a static)
+/// it is registered in the resource system by load() and unregisters itself in the destructor
 class SimplePersistentStore
 {
 public:
@@ -50,13 +79,22 @@ public:
     // loads persistence info from file and injects it into the resource system
     // returns false on error
     // non-existing store is currently also returning false (TODO)
+    // NOTE: a store that was written with a different hash format (see RES_HASH_BACKEND_SHA1)
+    //       cannot be used and is discarded
     bool load();
 
     // saves persistence data to disk
     // returns false on error
+    // NOTE: with write_behind, this only schedules a write and returns immediately
     bool save();
 
+    // saves persistence data to disk and waits until it is written
+    // returns false on error
+    // NOTE: same as save() without write_behind, should be called before shutdown
+    bool flush();
+
     // tries to look up missing content
+    // NOTE: threadsafe and lock-free, can be called concurrently (also with save)
     cc::optional<res::base::computation_result> try_get_content(base::content_hash hash);
 
     // types
@@ -69,17 +107,43 @@ private:
     };
     static_assert(sizeof(content_info) == 16);
     struct content_data;
+    template <class ValueT>
+    struct mapped_index;
+    struct invoc_index;
+
+    // stores referencing more content data files are considered corrupted
+    static constexpr int max_content_files = 256;
 
 private:
+    cc::string format_filename() const;
     cc::string invoc_filename() const;
     cc::string content_filename() const;
+    cc::string invoc_index_filename() const;
+    cc::string content_index_filename() const;
     cc::string content_data_filename(int file) const;
 
+    // true if format.bin matches the current build
+    // stores without format.bin are from before hash formats were tagged and used SHA1
+    bool is_compatible_format() const;
+    // returns false on error
+    bool write_format_if_missing();
+    void discard_files();
+
     void close_open_data();
-    void ensure_open_data(uint32_t file);
+    // returns the mapping of the file (opened on first use)
+    // NOTE: threadsafe and lock-free
+    content_data* ensure_open_data(uint32_t file);
 
     res::base::computation_result get_content_from_info(content_info info);
 
+    // appends all new invocs and contents to the files
+    // returns false on error (e.g. a file could not be written)
+    // NOTE: requires _mutex
+    bool write_new_data();
+
+    void writer_loop();
+    void stop_writer();
+
     // config
 private:
     simple_persistence_config _config;
@@ -87,16 +151,38 @@ private:
 
     // mutable member
 private:
-    cc::set<res::base::invoc_hash> _cached_invocs;
-    cc::map<res::base::content_hash, content_info> _content;
-
-    // idx is file
-    cc::vector<cc::unique_ptr<content_data>> _data;
-
-    // for now simply mutex everything public...
+    // NOTE: immutable after load, so they can be queried concurrently without locking
+    //       save updates the index files on disk, which are used by the next load
+    // NOTE: the invoc index is the base layer of the invoc store until the store is destroyed
+    cc::unique_ptr<invoc_index> _invoc_index;
+    cc::unique_ptr<mapped_index<content_info>> _content_index;
+
+    // idx is file, nullptr if not opened yet
+    // NOTE: refcounted, contents served without copy keep their file mapped
+    std::atomic<content_data*> _data[max_content_files] = {};
+
+    // contents written by this store since load (not part of the mapped content index)
+    // NOTE: only added once contents.bin references their data, invocs are only saved with persisted content
+    // NOTE: many invocs can have the same content
+    cc::set<base::content_hash> _written_contents;
+
+    // serializes load and writing (try_get_content does not lock)
     std::mutex _mutex;
 
     bool _is_loaded = false;
+
+    // registration in the resource system, removed by the destructor
+    cc::optional<base::content_provider_id> _content_provider;
+    bool _is_invoc_layer = false;
+
+    // write-behind thread, requests are counted in rounds
+    std::thread _writer;
+    std::mutex _writer_mutex;
+    std::condition_variable _writer_cv;
+    uint64_t _write_rounds_requested = 0;
+    uint64_t _write_rounds_finished = 0;
+    bool _last_write_ok = true;
+    bool _stop_writer = false;
 };
 
 } // namespace res::persistence
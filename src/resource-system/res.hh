@@ -2,5 +2,6 @@
 
 // aggregated header for using the computation graph resource system
 
+#include <resource-system/coro.hh>
 #include <resource-system/define.hh>
 #include <resource-system/handle.hh>
@@ -1,6 +1,14 @@
 #include <nexus/test.hh>
 
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
 #include <resource-system/System.hh>
+#include <resource-system/persistence/simple.hh>
 #include <resource-system/res.hh>
 
 TEST("res handle types")
@@ -150,6 +158,61 @@ TEST("res propagate change")
     CHECK(*h.try_get() == 12);
 }
 
+TEST("res dirty propagation")
+{
+    auto& base = res::system().base();
+
+    int x = 1;
+    int y = 2;
+    int eval_count = 0;
+    auto add = res::node_runtime(
+        [&eval_count](int a, int b)
+        {
+            eval_count++;
+            return a + b;
+        });
+
+    auto hx = res::define_volatile([&x] { return x; });
+    auto hy = res::define_volatile([&y] { return y; });
+    auto pure = res::define(add, 100, 200);
+    auto dx = res::define(add, hx, 1000);
+    auto dy = res::define(add, hy, 2000);
+
+    for (auto h : {pure, dx, dy})
+        h.try_get();
+    res::system().process_all();
+    CHECK(*pure.try_get() == 300);
+    CHECK(*dx.try_get() == 1001);
+    CHECK(*dy.try_get() == 2002);
+    CHECK(eval_count == 3);
+
+    // only the changed root and its dependents become dirty
+    x = 5;
+    res::system().invalidate_volatile_resource(hx.get_hash());
+    CHECK(!base.try_get_resource_content(pure.get_hash(), false).value().is_outdated);
+    CHECK(!base.try_get_resource_content(dy.get_hash(), false).value().is_outdated);
+    CHECK(base.try_get_resource_content(dx.get_hash(), false).value().is_outdated);
+
+    dx.try_get();
+    res::system().process_all();
+    CHECK(*dx.try_get() == 1005);
+    CHECK(*dy.try_get() == 2002);
+    CHECK(eval_count == 4);
+
+    // all volatile roots
+    x = 6;
+    y = 7;
+    res::system().invalidate_volatile_resources();
+    CHECK(!base.try_get_resource_content(pure.get_hash(), false).value().is_outdated);
+    for (auto h : {pure, dx, dy})
+        h.try_get();
+    res::system().process_all();
+    CHECK(*pure.try_get() == 300);
+    CHECK(*dx.try_get() == 1006);
+    CHECK(*dy.try_get() == 2007);
+    CHECK(eval_count == 6);
+}
+
 TEST("res invoc caching")
 {
     int eval_count = 0;
@@ -185,6 +248,868 @@ TEST("res invoc caching")
     CHECK(eval_count == 1); // should have used cached invocation even if used a constant
 }
 
+TEST("res worker pool")
+{
+    auto add = res::node_runtime([](int a, int b) { return a + b; });
+
+    cc::vector<res::handle<int>> handles;
+    for (auto i = 0; i < 100; ++i)
+    {
+        auto h0 = res::define(add, i, 1);
+        auto h1 = res::define(add, h0, h0);
+        handles.push_back(res::define(add, h1, i));
+    }
+
+    res::system().start_workers(4);
+
+    for (auto const& h : handles)
+        h.try_get();
+
+    res::system().process_until_idle();
+    res::system().stop_workers();
+
+    for (auto i = 0; i < 100; ++i)
+    {
+        CHECK(handles[i].try_get() != nullptr);
+        CHECK(*handles[i].try_get() == 3 * i + 2);
+    }
+}
+
+TEST("res content eviction")
+{
+    auto& base = res::system().base();
+
+    int eval_count = 0;
+    auto f = res::node_runtime(
+        [&eval_count](int a)
+        {
+            eval_count++;
+            return a * 10 + 1;
+        });
+
+    auto a = res::define(f, 9001);
+    auto b = res::define(f, 9002);
+    auto const hash_a = a.get_hash();
+    auto const hash_b = b.get_hash();
+
+    a.try_get();
+    b.try_get();
+    res::system().process_all();
+    CHECK(*a.try_get() == 90011);
+    CHECK(*b.try_get() == 90021);
+    CHECK(eval_count == 2);
+    CHECK(base.get_memory_usage() > 0);
+
+    // handles keep their content alive
+    res::system().collect_garbage();
+    CHECK(*a.try_get() == 90011);
+    CHECK(*b.try_get() == 90021);
+    CHECK(eval_count == 2);
+
+    // unreferenced content is evicted and recomputed on demand
+    base.pin_resource(hash_a);
+    a = {};
+    b = {};
+    auto const usage_before = base.get_memory_usage();
+    CHECK(res::system().collect_garbage() > 0);
+    CHECK(base.get_memory_usage() < usage_before);
+    CHECK(!base.try_get_resource_content(hash_b, false).has_value());
+
+    // pinned content stays resident
+    {
+        auto content = base.try_get_resource_content(hash_a, false);
+        CHECK(content.has_value());
+        CHECK(!content.value().is_outdated);
+    }
+
+    b = res::define(f, 9002);
+    b.try_get();
+    res::system().process_all();
+    CHECK(*b.try_get() == 90021);
+    CHECK(eval_count == 3);
+
+    base.unpin_resource(hash_a);
+    res::system().collect_garbage();
+    CHECK(!base.try_get_resource_content(hash_a, false).has_value());
+
+    // a tiny budget causes eviction of everything that is not in use
+    base.set_memory_budget(0);
+    CHECK(base.get_memory_budget() == 0);
+    auto c = res::define(f, b);
+    c.try_get();
+    res::system().process_all();
+    CHECK(*c.try_get() == 900211);
+    CHECK(*b.try_get() == 90021);
+
+    // replaced content stays valid until the next collect_garbage
+    int x = 1;
+    auto v = res::define_volatile([&x] { return x; });
+    auto d = res::define(f, v);
+    d.try_get();
+    res::system().process_all();
+    auto const p_old = d.try_get();
+    CHECK(p_old != nullptr && *p_old == 11);
+    x = 2;
+    res::system().invalidate_volatile_resources();
+    d.try_get();
+    res::system().process_all();
+    CHECK(*d.try_get() == 21);
+    base.evict_unused_content();
+    CHECK(*p_old == 11);
+    res::system().collect_garbage();
+    CHECK(*d.try_get() == 21);
+    base.set_memory_budget(-1);
+}
+
+TEST("res async computation")
+{
+    auto& base = res::system().base();
+
+    std::mutex threads_mutex;
+    cc::vector<std::thread> threads;
+
+    // completes from another thread after a while
+    res::base::computation_desc comp_double;
+    comp_double.algo_hash = res::base::make_random_unique_hash();
+    comp_double.compute_resource_async = [&](cc::span<res::base::content_ref const> args, res::base::computation_promise promise)
+    {
+        auto const v = res::detail::get_resource_arg<int>(args[0]);
+        auto lock = std::lock_guard(threads_mutex);
+        threads.emplace_back(
+            [v, promise = cc::move(promise)]() mutable
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                promise.complete(res::detail::make_comp_result<int>(v * 2));
+            });
+    };
+
+    // never completes
+    res::base::computation_desc comp_abandon;
+    comp_abandon.algo_hash = res::base::make_random_unique_hash();
+    comp_abandon.compute_resource_async = [](cc::span<res::base::content_ref const>, res::base::computation_promise) {};
+
+    auto arg = res::create(21);
+    auto const arg_hash = arg.get_hash();
+
+    res::base::resource_desc rdesc;
+    rdesc.args = cc::span<res::base::res_hash const>(&arg_hash, 1);
+    rdesc.is_persisted = false;
+    rdesc.deserialize = res::resource_traits<int>::make_deserialize();
+
+    rdesc.computation = base.define_computation(cc::move(comp_double));
+    auto const res_double = base.define_resource(rdesc).first;
+    rdesc.computation = base.define_computation(cc::move(comp_abandon));
+    auto const res_abandon = base.define_resource(rdesc).first;
+
+    CHECK(!base.try_get_resource_content(res_double).has_value());
+    CHECK(!base.try_get_resource_content(res_abandon).has_value());
+
+    // waits for the async completion
+    res::system().process_until_idle();
+
+    auto content = base.try_get_resource_content(res_double);
+    CHECK(content.has_value());
+    CHECK(res::detail::get_resource_arg<int>(content.value()) == 42);
+
+    auto error = base.try_get_resource_content(res_abandon);
+    CHECK(error.has_value());
+    CHECK(error.value().has_error());
+
+    for (auto& t : threads)
+        t.join();
+}
+
+TEST("res executors")
+{
+    auto const main_id = std::this_thread::get_id();
+
+    // runs tasks on a new thread each
+    struct thread_executor : res::base::executor
+    {
+        std::mutex mutex;
+        cc::vector<std::thread> threads;
+        int task_count = 0;
+
+        void execute(cc::unique_function<void()> task) override
+        {
+            auto lock = std::lock_guard(mutex);
+            task_count++;
+            threads.emplace_back([task = cc::move(task)]() mutable { task(); });
+        }
+        ~thread_executor() override
+        {
+            for (auto& t : threads)
+                t.join();
+        }
+    };
+    auto custom = cc::make_unique<thread_executor>();
+    auto& custom_ref = *custom;
+    res::system().base().set_executor(res::base::executor_id::first_custom, cc::move(custom));
+
+    std::atomic<int> io_count = 0;
+    auto load = res::node_runtime(
+        [&io_count, main_id](int i)
+        {
+            CHECK(std::this_thread::get_id() != main_id);
+            io_count++;
+            return i * 10;
+        },
+        res::executor_id::io);
+
+    auto upload = res::node_runtime(
+        [main_id](int i)
+        {
+            CHECK(std::this_thread::get_id() == main_id);
+            return i + 1;
+        },
+        res::executor_id::main_thread);
+
+    auto custom_add = res::node_runtime([](int a, int b) { return a + b; }, res::executor_id::first_custom);
+
+    auto h_load = res::define(load, 4);
+    auto h_upload = res::define(upload, h_load);
+    auto h_sum = res::define(custom_add, h_upload, h_load);
+
+    res::system().start_workers(2);
+
+    // main thread jobs are only executed at controlled points
+    h_upload.try_get();
+    while (!h_upload.try_get())
+        res::system().process_main_thread_jobs();
+    CHECK(*h_upload.try_get() == 41);
+
+    h_sum.try_get();
+    res::system().process_until_idle();
+    res::system().stop_workers();
+    CHECK(*h_sum.try_get() == 81);
+    CHECK(io_count == 1);
+    CHECK(custom_ref.task_count == 1);
+
+    res::system().base().set_executor(res::base::executor_id::first_custom, nullptr);
+}
+
+TEST("res cancellation")
+{
+    auto& base = res::system().base();
+
+    int eval_count = 0;
+    auto inc = res::node_runtime(
+        [&eval_count](int a)
+        {
+            eval_count++;
+            return a + 1;
+        });
+
+    auto one = res::create(1);
+    auto ten = res::create(10);
+
+    // work of resources without handles is skipped
+    {
+        auto h = res::define(inc, ten);
+        h.try_get();
+    }
+    res::system().process_until_idle();
+    CHECK(eval_count == 0);
+
+    // unless a referenced resource depends on it
+    auto h_dep = res::define(inc, res::define(inc, one));
+    h_dep.try_get();
+    res::system().process_until_idle();
+    CHECK(*h_dep.try_get() == 3);
+    CHECK(eval_count == 2);
+
+    // cancelled resources can be requested again
+    auto h = res::define(inc, ten);
+    h.try_get();
+    res::system().process_until_idle();
+    CHECK(*h.try_get() == 11);
+    CHECK(eval_count == 3);
+
+    // in-flight computations can opt into cooperative cancellation
+    std::mutex promise_mutex;
+    res::base::computation_promise promise;
+    res::base::computation_desc comp_desc;
+    comp_desc.algo_hash = res::base::make_random_unique_hash();
+    comp_desc.compute_resource_async = [&](cc::span<res::base::content_ref const>, res::base::computation_promise p)
+    {
+        auto lock = std::lock_guard(promise_mutex);
+        promise = cc::move(p);
+    };
+
+    auto const arg_hash = one.get_hash();
+    res::base::resource_desc rdesc;
+    rdesc.computation = base.define_computation(cc::move(comp_desc));
+    rdesc.args = cc::span<res::base::res_hash const>(&arg_hash, 1);
+    rdesc.is_persisted = false;
+    auto const [res, counter] = base.define_resource(rdesc);
+
+    res::system().start_workers(1);
+    base.try_get_resource_content(res);
+    while (true)
+    {
+        auto lock = std::lock_guard(promise_mutex);
+        if (promise.is_pending())
+            break;
+    }
+    CHECK(!promise.is_cancelled());
+
+    counter->dec();
+    CHECK(promise.is_cancelled());
+    promise.cancel();
+    res::system().process_until_idle();
+    res::system().stop_workers();
+    CHECK(!base.try_get_resource_content(res, false).has_value());
+}
+
+TEST("res priorities")
+{
+    // without workers, all jobs are processed in order by process_until_idle
+    cc::vector<int> order;
+    auto record = res::node_runtime(
+        [&order](int a)
+        {
+            order.push_back(a);
+            return a * 10;
+        });
+
+    // higher priorities first, dependencies inherit the priority
+    auto h_bg = res::define(record, 1);
+    auto h_normal = res::define(record, 3);
+    auto h_high = res::define(record, res::define(record, 2));
+    h_bg.try_get(res::priority::background);
+    h_normal.try_get();
+    h_high.try_get(res::priority::high);
+    res::system().process_until_idle();
+    CHECK(order == cc::vector<int>{2, 20, 3, 1});
+
+    // requesting again with a higher priority boosts enqueued jobs
+    order.clear();
+    auto h_boosted = res::define(record, 5);
+    auto h_other = res::define(record, 6);
+    h_boosted.try_get(res::priority::background);
+    h_other.try_get();
+    h_boosted.try_get(res::priority::high);
+    res::system().process_until_idle();
+    CHECK(order == cc::vector<int>{5, 6});
+
+    // lower priorities do not starve
+    order.clear();
+    auto constexpr high_count = 100;
+    cc::vector<res::handle<int>> highs;
+    auto h_starving = res::define(record, -1);
+    h_starving.try_get(res::priority::background);
+    for (auto i = 0; i < high_count; ++i)
+    {
+        highs.push_back(res::define(record, 1000 + i));
+        highs.back().try_get(res::priority::high);
+    }
+    res::system().process_until_idle();
+    CHECK(order.size() == high_count + 1);
+    auto starving_pos = 0;
+    while (order[starving_pos] != -1)
+        ++starving_pos;
+    CHECK(starving_pos < high_count / 2);
+    CHECK(*h_starving.try_get() == -10);
+}
+
+TEST("res boosted in-flight computation")
+{
+    auto& base = res::system().base();
+
+    // boosting a resource whose computation is in flight does not compute it again
+    std::mutex promise_mutex;
+    res::base::computation_promise promise;
+    int call_count = 0;
+    res::base::computation_desc comp_desc;
+    comp_desc.algo_hash = res::base::make_random_unique_hash();
+    comp_desc.compute_resource_async = [&](cc::span<res::base::content_ref const> args, res::base::computation_promise p)
+    {
+        auto lock = std::lock_guard(promise_mutex);
+        call_count++;
+        if (!promise.is_pending())
+            promise = cc::move(p);
+    };
+
+    auto arg = res::create(7);
+    auto const arg_hash = arg.get_hash();
+    res::base::resource_desc rdesc;
+    rdesc.computation = base.define_computation(cc::move(comp_desc));
+    rdesc.args = cc::span<res::base::res_hash const>(&arg_hash, 1);
+    rdesc.is_persisted = false;
+    rdesc.deserialize = res::resource_traits<int>::make_deserialize();
+    auto const [res, counter] = base.define_resource(rdesc);
+
+    res::system().start_workers(1);
+    CHECK(!base.try_get_resource_content(res).has_value());
+    while (true)
+    {
+        auto lock = std::lock_guard(promise_mutex);
+        if (promise.is_pending())
+            break;
+    }
+
+    CHECK(!base.try_get_resource_content(res, true, res::priority::high).has_value());
+    // gives the worker time to pop the boosted job
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    {
+        auto lock = std::lock_guard(promise_mutex);
+        promise.complete(res::detail::make_comp_result<int>(14));
+    }
+    res::system().process_until_idle();
+    res::system().stop_workers();
+
+    auto content = base.try_get_resource_content(res, false);
+    CHECK(content.has_value());
+    CHECK(res::detail::get_resource_arg<int>(content.value()) == 14);
+    CHECK(call_count == 1);
+    counter->dec();
+}
+
+TEST("res batched try_get")
+{
+    auto square = res::node_runtime([](int a) { return a * a; });
+
+    cc::vector<res::handle<int>> handles;
+    for (auto i = 0; i < 1000; ++i)
+        handles.push_back(res::define(square, i));
+    handles.push_back({}); // invalid handles are allowed
+
+    cc::vector<int const*> data;
+    data.resize(handles.size());
+
+    // first pass only enqueues
+    CHECK(res::try_get_all<int>(handles, data) == 0);
+    res::system().process_until_idle();
+
+    CHECK(res::try_get_all<int>(handles, data) == 1000);
+    for (auto i = 0; i < 1000; ++i)
+        CHECK(data[i] != nullptr && *data[i] == i * i);
+    CHECK(data.back() == nullptr);
+
+    // same results as the unbatched version
+    for (auto i = 0; i < 1000; ++i)
+        CHECK(handles[i].try_get() == data[i]);
+
+    // base API
+    auto& base = res::system().base();
+    cc::vector<res::base::res_hash> hashes;
+    for (auto i = 0; i < 1000; ++i)
+        hashes.push_back(handles[i].get_hash());
+    hashes.push_back(res::define(square, 2000).get_hash());
+
+    cc::vector<cc::optional<res::base::content_ref>> contents;
+    contents.resize(hashes.size());
+    CHECK(base.try_get_resource_contents(hashes, contents) == 1000);
+    CHECK(contents[7].has_value() && contents[7].value().data_ptr == data[7]);
+    CHECK(!contents.back().has_value());
+}
+
+TEST("res bulk define")
+{
+    auto& base = res::system().base();
+
+    int x = 1;
+    auto hx = res::define_volatile([&x] { return x; });
+    auto h1 = res::create(1);
+
+    res::base::computation_desc comp_desc;
+    comp_desc.algo_hash = res::base::make_random_unique_hash();
+    comp_desc.compute_resource = [](cc::span<res::base::content_ref const> args) -> res::base::computation_result
+    {
+        auto sum = 0;
+        for (auto const& a : args)
+            sum += res::detail::get_resource_arg<int>(a);
+        return res::detail::make_comp_result<int>(sum);
+    };
+    auto const comp = base.define_computation(cc::move(comp_desc));
+
+    // sums of 1 and x, i.e. some depend on a volatile resource
+    auto constexpr count = 1000;
+    cc::vector<res::base::res_hash> args;
+    for (auto i = 0; i < count; ++i)
+        args.push_back(i % 3 == 0 ? hx.get_hash() : h1.get_hash());
+
+    cc::vector<res::base::resource_desc> descs;
+    for (auto i = 0; i < count; ++i)
+    {
+        res::base::resource_desc d;
+        d.computation = comp;
+        d.args = cc::span<res::base::res_hash const>(args).subspan(0, i % 10 + 1);
+        d.is_persisted = false;
+        d.deserialize = res::resource_traits<int>::make_deserialize();
+        descs.push_back(d);
+    }
+
+    cc::vector<cc::pair<res::base::res_hash, res::base::ref_count*>> defined;
+    defined.resize(count);
+    base.define_resources(descs, defined);
+
+    // same as single definitions (duplicates included)
+    for (auto i = 0; i < count; ++i)
+    {
+        auto const [res, counter] = base.define_resource(descs[i]);
+        CHECK(res == defined[i].first);
+        CHECK(counter == defined[i].second);
+        counter->dec();
+    }
+    CHECK(defined[0].first == defined[10].first);
+
+    auto const expected = [&](int i)
+    {
+        auto sum = 0;
+        for (auto a = 0; a <= i % 10; ++a)
+            sum += a % 3 == 0 ? x : 1;
+        return sum;
+    };
+    auto const check_all = [&]
+    {
+        for (auto const& [res, counter] : defined)
+            base.try_get_resource_content(res);
+        res::system().process_until_idle();
+        for (auto i = 0; i < count; ++i)
+        {
+            auto content = base.try_get_resource_content(defined[i].first);
+            CHECK(content.has_value() && !content.value().is_outdated);
+            CHECK(res::detail::get_resource_arg<int>(content.value()) == expected(i));
+        }
+    };
+    check_all();
+
+    // dependents of the volatile resource are tracked
+    x = 5;
+    res::system().invalidate_volatile_resources();
+    check_all();
+
+    for (auto const& [res, counter] : defined)
+        counter->dec();
+
+    // large batches are hashed in parallel, with the same result
+    auto constexpr large_count = 70000;
+    cc::vector<res::base::resource_desc> large_descs;
+    for (auto i = 0; i < large_count; ++i)
+    {
+        res::base::resource_desc d = descs[0];
+        d.args = cc::span<res::base::res_hash const>(args).subspan(i % 900, i / 900 % 50 + 1);
+        large_descs.push_back(d);
+    }
+
+    cc::vector<cc::pair<res::base::res_hash, res::base::ref_count*>> large_defined;
+    large_defined.resize(large_count);
+    base.define_resources(large_descs, large_defined);
+    auto large_matches = 0;
+    for (auto i = 0; i < large_count; ++i)
+    {
+        auto const [res, counter] = base.define_resource(large_descs[i]);
+        large_matches += res == large_defined[i].first;
+        counter->dec();
+        large_defined[i].second->dec();
+    }
+    CHECK(large_matches == large_count);
+}
+
+namespace
+{
+std::atomic<int> deserialize_count = 0;
+}
+
+TEST("res shared runtime data")
+{
+    auto& base = res::system().base();
+
+    // all resources compute the same content, which is then deserialized by a different deserializer
+    res::base::computation_desc comp_desc;
+    comp_desc.algo_hash = res::base::make_random_unique_hash();
+    comp_desc.compute_resource = [](cc::span<res::base::content_ref const>) { return res::detail::make_comp_result<int>(42); };
+    auto const comp = base.define_computation(cc::move(comp_desc));
+
+    auto const deserialize = [](cc::span<std::byte const> blob)
+    {
+        deserialize_count++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        res::base::content_runtime_data data;
+        data.data_ptr = const_cast<std::byte*>(blob.data());
+        return data;
+    };
+
+    cc::vector<res::handle<int>> args;
+    cc::vector<res::base::res_hash> resources;
+    for (auto i = 0; i < 32; ++i)
+    {
+        args.push_back(res::create(i));
+        auto const arg = args.back().get_hash();
+
+        res::base::resource_desc rdesc;
+        rdesc.computation = comp;
+        rdesc.args = cc::span<res::base::res_hash const>(&arg, 1);
+        rdesc.is_persisted = false;
+        rdesc.deserialize = deserialize;
+        resources.push_back(base.define_resource(rdesc).first);
+    }
+
+    res::system().start_workers(4);
+    for (auto r : resources)
+        base.try_get_resource_content(r);
+    res::system().process_until_idle();
+    res::system().stop_workers();
+
+    // deserialized exactly once and shared by all resources
+    CHECK(deserialize_count == 1);
+    auto const first = base.try_get_resource_content(resources[0]);
+    CHECK(first.has_value() && first.value().data_ptr != nullptr);
+    for (auto r : resources)
+    {
+        auto const content = base.try_get_resource_content(r);
+        CHECK(content.has_value() && content.value().data_ptr == first.value().data_ptr);
+    }
+}
+
+namespace
+{
+// NOTE: content providers stay injected, so they must not reference test-local state
+std::atomic<int> provider_calls = 0;
+std::atomic<bool> provider_on_main_thread = false;
+std::thread::id provider_main_id;
+}
+
+TEST("res content provider loading")
+{
+    auto& base = res::system().base();
+    provider_main_id = std::this_thread::get_id();
+
+    int eval_count = 0;
+    auto f = res::node_runtime(
+        [&eval_count](int a)
+        {
+            eval_count++;
+            return a * 10 + 3;
+        });
+
+    auto a = res::define(f, 7331);
+    auto b = res::define(f, 7332);
+    a.try_get();
+    b.try_get();
+    res::system().process_until_idle();
+    CHECK(*a.try_get() == 73313);
+    CHECK(*b.try_get() == 73323);
+    CHECK(eval_count == 2);
+    auto const content_a = base.try_get_resource_content(a.get_hash()).value().hash;
+
+    // only provides the content of a
+    auto const provider = base.inject_content_provider(
+        [content_a](res::base::content_hash hash) -> cc::optional<res::base::computation_result>
+        {
+            provider_calls++;
+            if (std::this_thread::get_id() == provider_main_id)
+                provider_on_main_thread = true;
+            if (hash != content_a)
+                return {};
+            return res::detail::make_comp_result<int>(73313);
+        });
+
+    a = {};
+    b = {};
+    res::system().collect_garbage();
+
+    // loading (and deserialization) never happens on the asking thread
+    a = res::define(f, 7331);
+    b = res::define(f, 7332);
+    CHECK(a.try_get() == nullptr);
+    CHECK(b.try_get() == nullptr);
+    res::system().process_until_idle();
+
+    CHECK(*a.try_get() == 73313);
+    CHECK(*b.try_get() == 73323);
+    CHECK(provider_calls == 2);
+    CHECK(!provider_on_main_thread);
+
+    // a was loaded, b was computed again after the provider had no content for it
+    CHECK(eval_count == 3);
+
+    // removed providers are not asked anymore
+    base.remove_content_provider(provider);
+    a = {};
+    res::system().collect_garbage();
+    a = res::define(f, 7331);
+    a.try_get();
+    res::system().process_until_idle();
+    CHECK(*a.try_get() == 73313);
+    CHECK(provider_calls == 2);
+    CHECK(eval_count == 4);
+}
+
+TEST("res persistent invocation log")
+{
+    auto& base = res::system().base();
+
+    auto f = res::node("res test persistent invocation log", 1, [](int a) { return a * 10 + 5; });
+    auto const contains = [](cc::span<cc::pair<res::base::invoc_hash, res::base::content_hash> const> invocs, res::base::content_hash content)
+    {
+        for (auto const& [i, c] : invocs)
+            if (c == content)
+                return true;
+        return false;
+    };
+
+    auto a = res::define(f, 1);
+    a.try_get();
+    res::system().process_until_idle();
+    auto const content_a = base.try_get_resource_content(a.get_hash()).value().hash;
+
+    // the first drain returns everything so far
+    CHECK(contains(base.drain_new_persistent_invocations(), content_a));
+    CHECK(base.drain_new_persistent_invocations().empty());
+
+    // afterwards only new invocations
+    auto b = res::define(f, 2);
+    b.try_get();
+    res::system().process_until_idle();
+    auto const content_b = base.try_get_resource_content(b.get_hash()).value().hash;
+
+    auto const new_invocs = base.drain_new_persistent_invocations();
+    CHECK(new_invocs.size() == 1);
+    CHECK(contains(new_invocs, content_b));
+    CHECK(base.drain_new_persistent_invocations().empty());
+}
+
+namespace
+{
+// a fixed lookup layer, like a previously persisted index
+struct single_invoc_layer final : res::base::invoc_layer
+{
+    res::base::invoc_hash invoc;
+    res::base::content_hash content;
+
+    cc::optional<res::base::content_hash> find(res::base::invoc_hash i) const override
+    {
+        if (i == invoc)
+            return content;
+        return cc::nullopt;
+    }
+};
+}
+
+TEST("res invoc layer with changed content")
+{
+    auto& base = res::system().base();
+
+    auto f = res::node("res test invoc layer with changed content", 1, [](int a) { return a * 10 + 7; });
+    auto a = res::define(f, 1);
+    auto b = res::define(f, 2);
+    a.try_get();
+    b.try_get();
+    res::system().process_until_idle();
+    auto const content_a = base.try_get_resource_content(a.get_hash()).value().hash;
+    auto const content_b = base.try_get_resource_content(b.get_hash()).value().hash;
+
+    single_invoc_layer layer;
+    for (auto const& [i, c] : base.collect_all_persistent_invocations())
+        if (c == content_a)
+            layer.invoc = i;
+    auto const collects_a = [&]
+    {
+        for (auto const& [i, c] : base.collect_all_persistent_invocations())
+            if (i == layer.invoc)
+                return c == content_a;
+        return false;
+    };
+
+    // a layer with the same content already knows the invoc
+    layer.content = content_a;
+    base.add_invoc_layer(&layer);
+    CHECK(!collects_a());
+    base.remove_invoc_layer(&layer);
+
+    // a layer with a different (e.g. previously persisted) content does not, the new content must be saved again
+    layer.content = content_b;
+    base.add_invoc_layer(&layer);
+    CHECK(collects_a());
+    base.remove_invoc_layer(&layer);
+}
+
+TEST("res persistent store retries failed writes")
+{
+    auto& base = res::system().base();
+
+    auto const dir = std::filesystem::temp_directory_path() / "res-test-persistent-store-retry";
+    std::filesystem::remove_all(dir);
+
+    // contents.bin cannot be written while it is a directory
+    std::filesystem::create_directories(dir / "contents.bin");
+
+    auto f = res::node("res test persistent store retry", 1, [](int a) { return a * 10 + 9; });
+    auto a = res::define(f, 1);
+    {
+        auto store = res::persistence::SimplePersistentStore(dir.string().c_str());
+        store.load();
+
+        a.try_get();
+        res::system().process_until_idle();
+        auto const content_a = base.try_get_resource_content(a.get_hash()).value().hash;
+
+        CHECK(!store.flush());
+
+        // the failed invocs are written by the next flush
+        std::filesystem::remove(dir / "contents.bin");
+        CHECK(store.flush());
+
+        auto file = std::ifstream(dir / "invocs.bin", std::ios::binary);
+        cc::pair<res::base::invoc_hash, res::base::content_hash> entry;
+        auto is_persisted = false;
+        while (file.read((char*)&entry, sizeof(entry)))
+            is_persisted = is_persisted || entry.second == content_a;
+        CHECK(is_persisted);
+    }
+
+    std::filesystem::remove_all(dir);
+}
+
+#if defined(__cpp_impl_coroutine)
+TEST("res coroutine node")
+{
+    int x = 1;
+    int eval_count = 0;
+    auto hx = res::define_volatile([&x] { return x; });
+    auto hc = res::create(10);
+    auto add = res::node_runtime([](int a, int b) { return a + b; });
+
+    // dependencies are only known after awaiting previous ones
+    auto sum = res::node_coro(
+        [&eval_count, &hx, &hc, &add](int selector) -> res::coro<int>
+        {
+            eval_count++;
+            int const a = co_await hc;
+            int const b = co_await (selector > 0 ? hx : hc);
+            int const c = co_await res::define(add, a, b);
+            co_return a + b + c;
+        });
+
+    auto s0 = res::define(sum, 0);
+    auto s1 = res::define(sum, 1);
+    s0.try_get();
+    s1.try_get();
+    res::system().process_all();
+    CHECK(*s0.try_get() == 40);
+    CHECK(*s1.try_get() == 22);
+    CHECK(eval_count == 2);
+
+    // discovered dependencies are tracked
+    x = 2;
+    res::system().invalidate_volatile_resource(hx.get_hash());
+    CHECK(!res::system().base().try_get_resource_content(s0.get_hash(), false).value().is_outdated);
+    CHECK(res::system().base().try_get_resource_content(s1.get_hash(), false).value().is_outdated);
+    s1.try_get();
+    res::system().process_all();
+    CHECK(*s1.try_get() == 24);
+    CHECK(eval_count == 3);
+
+    // same dynamic args -> cached invocation
+    res::system().invalidate_volatile_resource(hx.get_hash());
+    s1.try_get();
+    res::system().process_all();
+    CHECK(*s1.try_get() == 24);
+    CHECK(eval_count == 3);
+}
+#endif
 
 // TODO: non-moveable types as args
 // TODO: error handling
@@ -0,0 +1,385 @@
+#include <nexus/app.hh>
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include <clean-core/experimental/ringbuffer.hh>
+#include <clean-core/hash.sha1.hh>
+
+#include <rich-log/log.hh>
+
+#include <resource-system/System.hh>
+#include <resource-system/detail/hash_helper.hh>
+#include <resource-system/detail/mpmc_queue.hh>
+#include <resource-system/res.hh>
+
+namespace
+{
+template <class F>
+double measure_ms(F&& f)
+{
+    auto const t0 = std::chrono::high_resolution_clock::now();
+    f();
+    auto const t1 = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(t1 - t0).count();
+}
+
+// each thread pushes and pops 'ops' elements in bursts
+template <class PushF, class PopF>
+double measure_queue_contention_ms(int threads, int ops, PushF&& push, PopF&& pop)
+{
+    return measure_ms(
+        [&]
+        {
+            cc::vector<std::thread> workers;
+            for (auto t = 0; t < threads; ++t)
+                workers.emplace_back(
+                    [&, t]
+                    {
+                        auto constexpr burst = 64;
+                        for (auto i = 0; i < ops; i += burst)
+                        {
+                            for (auto j = 0; j < burst; ++j)
+                                push(uint64_t(t * ops + i + j));
+                            for (auto j = 0; j < burst; ++j)
+                                while (!pop())
+                                {
+                                }
+                        }
+                    });
+            for (auto& w : workers)
+                w.join();
+        });
+}
+} // namespace
+
+APP("bench res deep chain")
+{
+    auto constexpr depth = 10000;
+
+    auto inc = res::node_runtime([](int a) { return a + 1; });
+
+    cc::vector<res::handle<int>> chain;
+    chain.push_back(res::create(0));
+    for (auto i = 1; i < depth; ++i)
+        chain.push_back(res::define(inc, chain.back()));
+
+    auto ms = measure_ms(
+        [&]
+        {
+            chain.back().try_get();
+            res::system().process_until_idle();
+        });
+
+    CC_ASSERT(*chain.back().try_get() == depth - 1);
+    LOG("deep chain (%s nodes): %.2f ms", depth, ms);
+}
+
+APP("bench res wide fan-in")
+{
+    auto constexpr width = 10000;
+
+    auto& base = res::system().base();
+
+    cc::vector<res::handle<int>> leaves;
+    cc::vector<res::base::res_hash> leaf_hashes;
+    for (auto i = 0; i < width; ++i)
+    {
+        leaves.push_back(res::create(1));
+        leaf_hashes.push_back(leaves.back().get_hash());
+    }
+
+    // a single node with 'width' args (only expressible in the base API)
+    res::base::computation_desc comp_desc;
+    comp_desc.algo_hash = res::base::make_random_unique_hash();
+    comp_desc.compute_resource = [](cc::span<res::base::content_ref const> args) -> res::base::computation_result
+    {
+        auto sum = 0;
+        for (auto const& a : args)
+            sum += res::detail::get_resource_arg<int>(a);
+        return res::detail::make_comp_result<int>(sum);
+    };
+
+    res::base::resource_desc res_desc;
+    res_desc.computation = base.define_computation(cc::move(comp_desc));
+    res_desc.args = leaf_hashes;
+    res_desc.is_persisted = false;
+    res_desc.deserialize = res::resource_traits<int>::make_deserialize();
+    auto const sum_res = base.define_resource(res_desc).first;
+
+    auto ms = measure_ms(
+        [&]
+        {
+            base.try_get_resource_content(sum_res);
+            res::system().process_until_idle();
+        });
+
+    auto content = base.try_get_resource_content(sum_res);
+    CC_ASSERT(content.has_value() && res::detail::get_resource_arg<int>(content.value()) == width);
+    LOG("wide fan-in (%s args): %.2f ms", width, ms);
+}
+
+APP("bench res cached lookup")
+{
+    auto constexpr count = 100000;
+    auto constexpr rounds = 10;
+
+    auto& base = res::system().base();
+
+    cc::vector<res::handle<int>> handles;
+    for (auto i = 0; i < count; ++i)
+        handles.push_back(res::create(i));
+    for (auto const& h : handles)
+        h.try_get();
+    res::system().process_until_idle();
+
+    // bypasses the handle-local cache to measure the per-resource cache of the base API
+    auto hits = 0;
+    auto ms = measure_ms(
+        [&]
+        {
+            for (auto r = 0; r < rounds; ++r)
+                for (auto const& h : handles)
+                    if (base.try_get_resource_content(h.get_hash()).has_value())
+                        ++hits;
+        });
+
+    CC_ASSERT(hits == count * rounds);
+    LOG("cached lookup (%s resources x %s): %.2f ms, %.1f ns per lookup", count, rounds, ms, ms * 1e6 / (count * rounds));
+}
+
+APP("bench res batched lookup")
+{
+    auto constexpr count = 100000;
+    auto constexpr rounds = 10;
+
+    auto& base = res::system().base();
+
+    cc::vector<res::handle<int>> handles;
+    cc::vector<res::base::res_hash> hashes;
+    for (auto i = 0; i < count; ++i)
+    {
+        handles.push_back(res::create(i));
+        hashes.push_back(handles.back().get_hash());
+    }
+    for (auto const& h : handles)
+        h.try_get();
+    res::system().process_until_idle();
+
+    cc::vector<cc::optional<res::base::content_ref>> contents;
+    contents.resize(count);
+
+    auto hits_single = 0;
+    auto ms_single = measure_ms(
+        [&]
+        {
+            for (auto r = 0; r < rounds; ++r)
+                for (auto i = 0; i < count; ++i)
+                {
+                    contents[i] = base.try_get_resource_content(hashes[i]);
+                    hits_single += contents[i].has_value();
+                }
+        });
+
+    auto hits_batched = 0;
+    auto ms_batched = measure_ms(
+        [&]
+        {
+            for (auto r = 0; r < rounds; ++r)
+                hits_batched += base.try_get_resource_contents(hashes, contents);
+        });
+
+    CC_ASSERT(hits_single == count * rounds && hits_batched == count * rounds);
+    LOG("lookup (%s resources x %s): single %.1f ns, batched %.1f ns per lookup", count, rounds, ms_single * 1e6 / (count * rounds),
+        ms_batched * 1e6 / (count * rounds));
+}
+
+APP("bench res bulk define")
+{
+    auto constexpr count = 500000;
+
+    auto& base = res::system().base();
+
+    cc::vector<res::handle<int>> leaves;
+    for (auto i = 0; i < 1000; ++i)
+        leaves.push_back(res::create(i));
+
+    // a few random args each, almost all definitions are unique
+    cc::vector<res::base::res_hash> args;
+    uint64_t rng = 0x9E3779B97F4A7C15uLL;
+    for (auto i = 0; i < count + 4; ++i)
+    {
+        rng = rng * 6364136223846793005uLL + 1442695040888963407uLL;
+        args.push_back(leaves[(rng >> 33) % leaves.size()].get_hash());
+    }
+
+    auto const make_descs = [&](res::base::comp_hash comp)
+    {
+        cc::vector<res::base::resource_desc> descs;
+        for (auto i = 0; i < count; ++i)
+        {
+            res::base::resource_desc d;
+            d.computation = comp;
+            d.args = cc::span<res::base::res_hash const>(args).subspan(i, 2 + i % 3);
+            d.is_persisted = false;
+            descs.push_back(d);
+        }
+        return descs;
+    };
+
+    auto const make_comp = [&]
+    {
+        res::base::computation_desc comp_desc;
+        comp_desc.algo_hash = res::base::make_random_unique_hash();
+        comp_desc.compute_resource = [](cc::span<res::base::content_ref const>) { return res::detail::make_comp_result<int>(0); };
+        return base.define_computation(cc::move(comp_desc));
+    };
+
+    auto const descs_single = make_descs(make_comp());
+    auto ms_single = measure_ms(
+        [&]
+        {
+            for (auto const& d : descs_single)
+                base.define_resource(d);
+        });
+
+    auto const descs_bulk = make_descs(make_comp());
+    cc::vector<cc::pair<res::base::res_hash, res::base::ref_count*>> defined;
+    defined.resize(count);
+    auto ms_bulk = measure_ms([&] { base.define_resources(descs_bulk, defined); });
+
+    LOG("define %s resources: single %.2f ms, bulk %.2f ms", count, ms_single, ms_bulk);
+}
+
+APP("bench res invalidation")
+{
+    auto constexpr count = 100000;
+    auto constexpr rounds = 100;
+
+    auto add = res::node_runtime([](int a, int b) { return a + b; });
+
+    // a single tweakable value with a few dependents next to many pure resources
+    int slider = 0;
+    auto tweak = res::define_volatile([&slider] { return slider; });
+    cc::vector<res::handle<int>> handles;
+    for (auto i = 0; i < count; ++i)
+        handles.push_back(res::define(add, i, i % 1000 == 0 ? tweak : res::create(1)));
+
+    for (auto const& h : handles)
+        h.try_get();
+    res::system().process_until_idle();
+
+    auto ms = measure_ms(
+        [&]
+        {
+            for (auto r = 0; r < rounds; ++r)
+            {
+                ++slider;
+                res::system().invalidate_volatile_resource(tweak.get_hash());
+                for (auto const& h : handles)
+                    h.try_get();
+                res::system().process_until_idle();
+            }
+        });
+
+    CC_ASSERT(*handles[0].try_get() == rounds);
+    LOG("invalidation (1 of %s resources volatile, %s dependents) x %s: %.2f ms per round", count, count / 1000, rounds, ms / rounds);
+}
+
+APP("bench res queue contention")
+{
+    auto constexpr ops = 1 << 18;
+
+    for (auto threads : {1, 2, 4, 8, 16, 32})
+    {
+        res::detail::mpmc_queue<uint64_t> mpmc;
+        auto ms_mpmc = measure_queue_contention_ms(
+            threads, ops, [&](uint64_t v) { mpmc.push(v); },
+            [&]
+            {
+                uint64_t v;
+                return mpmc.try_pop(v);
+            });
+
+        cc::ringbuffer<uint64_t> ring;
+        std::mutex ring_mutex;
+        auto ms_ring = measure_queue_contention_ms(
+            threads, ops,
+            [&](uint64_t v)
+            {
+                auto lock = std::lock_guard{ring_mutex};
+                ring.push_back(v);
+            },
+            [&]
+            {
+                auto lock = std::lock_guard{ring_mutex};
+                if (ring.empty())
+                    return false;
+                ring.pop_front();
+                return true;
+            });
+
+        LOG("%2s threads: mpmc_queue %8.2f ms, mutex + ringbuffer %8.2f ms", threads, ms_mpmc, ms_ring);
+    }
+}
+
+APP("bench res hash backends")
+{
+    auto constexpr count = 1 << 18;
+
+    // typical hash inputs are short: a few hashes plus some tags
+    cc::vector<std::byte> data;
+    cc::vector<cc::span<std::byte const>> inputs;
+    {
+        cc::vector<cc::pair<size_t, size_t>> ranges;
+        uint64_t rng = 0x9E3779B97F4A7C15uLL;
+        for (auto i = 0; i < count; ++i)
+        {
+            rng = rng * 6364136223846793005uLL + 1442695040888963407uLL;
+            auto const size = 16 + size_t(rng >> 33) % 185;
+            ranges.push_back({data.size(), size});
+            for (size_t j = 0; j < size; ++j)
+                data.push_back(std::byte(rng >> (j % 56)));
+        }
+        for (auto [offset, size] : ranges)
+            inputs.push_back(cc::span<std::byte const>(data).subspan(offset, size));
+    }
+
+    cc::vector<res::base::hash> out;
+    out.resize(count);
+    uint64_t checksum = 0;
+
+    auto ms_sha1 = measure_ms(
+        [&]
+        {
+            for (auto in : inputs)
+            {
+                cc::sha1_builder b;
+                b.add(in);
+                checksum += res::detail::finalize_as<res::base::hash>(b).w0;
+            }
+        });
+
+    auto ms_fast = measure_ms(
+        [&]
+        {
+            for (auto in : inputs)
+            {
+                res::detail::fast_hash_builder b;
+                b.add(in);
+                checksum += b.finalize().w0;
+            }
+        });
+
+    auto ms_many = measure_ms([&] { res::detail::hash_many(inputs, out); });
+
+    for (size_t i = 0; i < inputs.size(); i += 997)
+    {
+        res::detail::fast_hash_builder b;
+        b.add(inputs[i]);
+        CC_ASSERT(b.finalize() == out[i] && "hash_many must match fast_hash_builder");
+    }
+
+    LOG("%s hashes (16..200 bytes): sha1 %.2f ms, fast %.2f ms, fast batched %.2f ms (checksum %s)", count, ms_sha1, ms_fast, ms_many, checksum);
+}
@@ -13,7 +13,10 @@
 APP("viewer resource demo")
 {
     //
-    auto res_cache = res::persistence::SimplePersistentStore(".res-cache");
+    // new results are persisted in the background while interacting
+    res::persistence::simple_persistence_config cache_cfg;
+    cache_cfg.write_behind = true;
+    auto res_cache = res::persistence::SimplePersistentStore(".res-cache", cache_cfg);
     res_cache.load();
 
     int cnt_make_grid = 0;
@@ -87,7 +90,8 @@ APP("viewer resource demo")
                 c.add_lines(tris, tg::color3::black).scale_size(0.2f);
 
             return c.create_renderables();
-        });
+        },
+        res::executor_id::main_thread); // creates GPU resources
 
     auto h_grid = res::define(make_grid_data, res::create_volatile_ref(gparams));
     auto h_renderables = res::load(make_renderables, h_grid, res::create_volatile_ref(vparams));
@@ -119,5 +123,5 @@ APP("viewer resource demo")
                     gv::view(r);
         });
 
-    res_cache.save();
+    res_cache.flush();
 }